@@ -0,0 +1,230 @@
+// kernel/bench.c
+// 调度与上下文切换基准测试，由 main_task 在所有测试之后运行。
+// 每个结果输出一行 "BENCH name=<指标> value=<数值> unit=<单位>"，
+// 便于从串口输出中用脚本提取、比较不同版本或配置的运行结果。
+#include "defs.h"
+
+#define BENCH_SWTCH_ROUNDS  10000
+#define BENCH_PP_ROUNDS     2000
+#define BENCH_WAKE_SAMPLES  200
+#define BENCH_FORKS         100
+#define BENCH_RQ_YIELDS     200
+#define BENCH_RQ_MAX        32
+
+static void bench_emit(const char *name, uint64 value, const char *unit) {
+    printf("BENCH name=%s value=%lu unit=%s\n", name, value, unit);
+}
+
+static uint64 time_to_ns(uint64 t) {
+    return t * 1000000000UL / machine.timebase;
+}
+
+// ---------------------------------------------------------------------------
+// swtch() 本身的开销：在同一个 hart 上的两个上下文之间来回切换，不经过调度器
+
+static struct context swtch_main_ctx;
+static struct context swtch_co_ctx;
+
+static void swtch_co(void) {
+    for (;;)
+        swtch(&swtch_co_ctx, &swtch_main_ctx);
+}
+
+static void bench_swtch(void) {
+    char *stack = kalloc();
+    if (stack == 0) {
+        printf("bench: no memory for swtch stack\n");
+        return;
+    }
+    memset(&swtch_co_ctx, 0, sizeof(swtch_co_ctx));
+    swtch_co_ctx.ra = (uint64)swtch_co;
+    swtch_co_ctx.sp = (uint64)stack + PGSIZE;
+
+    push_off();
+    uint64 start = r_cycle();
+    for (int i = 0; i < BENCH_SWTCH_ROUNDS; i++) {
+        swtch(&swtch_main_ctx, &swtch_co_ctx);
+    }
+    uint64 cycles = r_cycle() - start;
+    pop_off();
+    kfree(stack);
+    bench_emit("swtch", cycles / (2 * BENCH_SWTCH_ROUNDS), "cycles");
+}
+
+// ---------------------------------------------------------------------------
+// 两个绑定在同一 CPU 上的进程互相 yield，一个来回包含两次进程切换
+
+static volatile int bench_go;
+static volatile int bench_ready;
+static volatile int bench_done;
+static volatile uint64 bench_end;
+
+static void bench_reset(void) {
+    bench_go = 0;
+    bench_ready = 0;
+    bench_done = 0;
+    bench_end = 0;
+}
+
+// 迁到 cpu 上并等待开始信号
+static void bench_join(int cpu) {
+    stub_setaffinity(0, cpu);
+    yield();
+    __atomic_fetch_add(&bench_ready, 1, __ATOMIC_SEQ_CST);
+    while (!bench_go)
+        yield();
+}
+
+// 最后一个完成的进程记下结束时刻
+static void bench_finish(int n) {
+    uint64 now = r_time();
+    if (__atomic_add_fetch(&bench_done, 1, __ATOMIC_SEQ_CST) == n)
+        bench_end = now;
+}
+
+// n 个进程在 cpu 上各 yield rounds 次，返回从开始到最后一个进程完成的时间
+static uint64 bench_yielders(int n, int cpu, int rounds) {
+    bench_reset();
+    int created = 0;
+    for (int i = 0; i < n; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            bench_join(cpu);
+            for (int r = 0; r < rounds; r++) {
+                yield();
+            }
+            bench_finish(n);
+            stub_exit(0);
+        }
+        if (pid > 0)
+            created++;
+    }
+    while (bench_ready < created)
+        yield();
+    uint64 start = r_time();
+    bench_go = 1;
+    for (int i = 0; i < created; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    if (created < n)
+        printf("bench: only %d of %d processes created\n", created, n);
+    return bench_end > start ? bench_end - start : 0;
+}
+
+static void bench_yield_pingpong(void) {
+    uint64 t = bench_yielders(2, machine.ncpu - 1, BENCH_PP_ROUNDS);
+    bench_emit("yield_pingpong", time_to_ns(t) / BENCH_PP_ROUNDS, "ns");
+}
+
+// ---------------------------------------------------------------------------
+// 唤醒到运行的延迟：从 wakeup() 到被唤醒的进程开始运行。等待者绑定在
+// 最后一个 CPU 上，多 CPU 时唤醒者在其他 CPU 上，包含 IPI 叫醒空闲 CPU 的时间
+
+static struct spinlock wake_lock;
+static volatile int wake_seq;
+static volatile int wake_sleeping;
+static volatile uint64 wake_sent;
+static uint64 wake_samples[BENCH_WAKE_SAMPLES];
+
+static void wake_sleeper(void) {
+    for (int i = 0; i < BENCH_WAKE_SAMPLES; i++) {
+        acquire(&wake_lock);
+        wake_sleeping = 1;
+        while (wake_seq <= i)
+            sleep((void*)&wake_seq, &wake_lock);
+        wake_samples[i] = r_time() - wake_sent;
+        release(&wake_lock);
+    }
+}
+
+static void sort_u64(uint64 *a, int n) {
+    for (int i = 1; i < n; i++) {
+        uint64 v = a[i];
+        int j = i - 1;
+        while (j >= 0 && a[j] > v) {
+            a[j + 1] = a[j];
+            j--;
+        }
+        a[j + 1] = v;
+    }
+}
+
+static void bench_wakeup_latency(void) {
+    spinlock_init(&wake_lock, "bench_wake");
+    wake_seq = 0;
+    wake_sleeping = 0;
+    int pid = stub_fork();
+    if (pid == 0) {
+        stub_setaffinity(0, machine.ncpu - 1);
+        wake_sleeper();
+        stub_exit(0);
+    }
+    if (pid < 0)
+        return;
+
+    for (int i = 0; i < BENCH_WAKE_SAMPLES; i++) {
+        // 看到 wake_sleeping 时等待者已经在 sleep() 中放开了锁
+        acquire(&wake_lock);
+        while (!wake_sleeping) {
+            release(&wake_lock);
+            yield();
+            acquire(&wake_lock);
+        }
+        wake_sleeping = 0;
+        wake_sent = r_time();
+        wake_seq++;
+        wakeup((void*)&wake_seq);
+        release(&wake_lock);
+    }
+    int status = 0;
+    stub_wait(&status);
+
+    sort_u64(wake_samples, BENCH_WAKE_SAMPLES);
+    bench_emit("wakeup_p50", time_to_ns(wake_samples[BENCH_WAKE_SAMPLES * 50 / 100]), "ns");
+    bench_emit("wakeup_p90", time_to_ns(wake_samples[BENCH_WAKE_SAMPLES * 90 / 100]), "ns");
+    bench_emit("wakeup_p99", time_to_ns(wake_samples[BENCH_WAKE_SAMPLES * 99 / 100]), "ns");
+    bench_emit("wakeup_max", time_to_ns(wake_samples[BENCH_WAKE_SAMPLES - 1]), "ns");
+}
+
+// ---------------------------------------------------------------------------
+// fork + exit + wait 的吞吐量
+
+static void bench_fork(void) {
+    uint64 start = r_time();
+    int n = 0;
+    for (int i = 0; i < BENCH_FORKS; i++) {
+        int pid = stub_fork();
+        if (pid == 0)
+            stub_exit(0);
+        if (pid < 0)
+            break;
+        int status = 0;
+        stub_wait(&status);
+        n++;
+    }
+    uint64 t = r_time() - start;
+    bench_emit("fork_exit_wait", t ? n * machine.timebase / t : 0, "ops/s");
+}
+
+// ---------------------------------------------------------------------------
+// 调度开销与可运行进程数的关系：n 个进程在同一 CPU 上轮流 yield，
+// 每次切换的平均时间应当与 n 无关
+
+static void bench_runq_scaling(void) {
+    for (int n = 1; n <= BENCH_RQ_MAX; n *= 2) {
+        uint64 t = bench_yielders(n, machine.ncpu - 1, BENCH_RQ_YIELDS);
+        printf("BENCH name=sched_switch_n%d value=%lu unit=ns\n",
+               n, time_to_ns(t) / (n * BENCH_RQ_YIELDS));
+    }
+}
+
+void run_sched_bench(void) {
+    printf("BENCH begin cpus=%d sched=%s tick_hz=%d\n", machine.ncpu, sched_policy_name(), TICK_HZ);
+    bench_swtch();
+    bench_yield_pingpong();
+    bench_wakeup_latency();
+    bench_fork();
+    bench_runq_scaling();
+    printf("BENCH end\n");
+}
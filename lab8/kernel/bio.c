@@ -14,7 +14,7 @@ struct {
 void binit(void) {
     struct buf *b;
 
-    spinlock_init(&bcache.lock, "bcache");
+    spinlock_init_type(&bcache.lock, "bcache", SPIN_MCS);
     bcache.head.prev = &bcache.head;
     bcache.head.next = &bcache.head;
 
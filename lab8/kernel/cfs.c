@@ -0,0 +1,327 @@
+// kernel/cfs.c
+// CFS 调度类：按权重分配 CPU 时间。每个进程的虚拟运行时间 vruntime 以
+// NICE_0_LOAD / 权重 的速率增长，总是运行 vruntime 最小的进程，
+// 于是长期来看各进程得到的 CPU 时间与权重成正比。
+//
+// 进程属于某个调度组，组的权重在组内进程之间按 nice 权重分配：
+// 有效权重 = 组权重 * 进程 nice 权重 / 组内所有进程 nice 权重之和。
+// 这样 CPU 在组之间按组权重分配，与各组的进程数无关。
+#include "defs.h"
+#include "sched.h"
+
+#define NICE_0_LOAD       1024
+#define CFS_LATENCY_TICKS 6     // 被唤醒的进程最多补偿半个调度周期
+#define CFS_MAX_DEPTH     64
+
+// nice -20..19 对应的权重，相邻两级相差约 1.25 倍 (与 Linux 相同)
+static const int prio_to_weight[NICE_MAX - NICE_MIN + 1] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,
+     3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,
+      335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,
+       36,    29,    23,    18,    15,
+};
+
+struct sched_group {
+    int weight;
+    int nr;                     // 组内进程数
+    uint64 load;                // 组内进程 nice 权重之和
+};
+
+static struct spinlock group_lock;
+static struct sched_group groups[NGROUP];
+
+static int nice_to_weight(int nice) {
+    return prio_to_weight[nice - NICE_MIN];
+}
+
+void sched_group_init(void) {
+    spinlock_init(&group_lock, "sched_group");
+    for (int i = 0; i < NGROUP; i++) {
+        groups[i].weight = NICE_0_LOAD;
+        groups[i].nr = 0;
+        groups[i].load = 0;
+    }
+}
+
+// 把 p 移到组 gid (p->group 为 -1 表示还不属于任何组)
+void sched_group_join(struct proc *p, int gid) {
+    acquire(&group_lock);
+    int w = nice_to_weight(p->nice);
+    if (p->group >= 0) {
+        groups[p->group].nr--;
+        groups[p->group].load -= w;
+    }
+    groups[gid].nr++;
+    groups[gid].load += w;
+    p->group = gid;
+    release(&group_lock);
+}
+
+void sched_group_leave(struct proc *p) {
+    acquire(&group_lock);
+    if (p->group >= 0) {
+        groups[p->group].nr--;
+        groups[p->group].load -= nice_to_weight(p->nice);
+        p->group = -1;
+    }
+    release(&group_lock);
+}
+
+// 修改 nice 值并同步更新所在组的负载
+void sched_group_renice(struct proc *p, int nice) {
+    acquire(&group_lock);
+    if (p->group >= 0) {
+        groups[p->group].load -= nice_to_weight(p->nice);
+        groups[p->group].load += nice_to_weight(nice);
+    }
+    __atomic_store_n(&p->nice, nice, __ATOMIC_RELAXED);
+    release(&group_lock);
+}
+
+int sched_group_set_weight(int gid, int weight) {
+    if (gid < 0 || gid >= NGROUP || weight <= 0 || weight > prio_to_weight[0])
+        return -1;
+    __atomic_store_n(&groups[gid].weight, weight, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// 进程的有效权重；无锁读取，组调整期间的误差只影响一次记账
+static uint64 cfs_weight(struct proc *p) {
+    uint64 w = nice_to_weight(p->nice);
+    if (p->group < 0)
+        return w;
+    struct sched_group *g = &groups[p->group];
+    uint64 load = g->load;
+    if (load < w)
+        load = w;
+    w = (uint64)g->weight * w / load;
+    return w ? w : 1;
+}
+
+// ---------------------------------------------------------------------------
+// 按 (vruntime, pid) 排序的 AVL 树，节点就是 proc 本身
+
+static int cfs_less(struct proc *a, struct proc *b) {
+    if (a->vruntime != b->vruntime)
+        return a->vruntime < b->vruntime;
+    return a->pid < b->pid;
+}
+
+static int avl_height(struct proc *n) {
+    return n ? n->cfs_height : 0;
+}
+
+static void avl_update(struct proc *n) {
+    int l = avl_height(n->cfs_left), r = avl_height(n->cfs_right);
+    n->cfs_height = 1 + (l > r ? l : r);
+}
+
+static struct proc *avl_rotate_right(struct proc *n) {
+    struct proc *l = n->cfs_left;
+    n->cfs_left = l->cfs_right;
+    l->cfs_right = n;
+    avl_update(n);
+    avl_update(l);
+    return l;
+}
+
+static struct proc *avl_rotate_left(struct proc *n) {
+    struct proc *r = n->cfs_right;
+    n->cfs_right = r->cfs_left;
+    r->cfs_left = n;
+    avl_update(n);
+    avl_update(r);
+    return r;
+}
+
+static struct proc *avl_balance(struct proc *n) {
+    avl_update(n);
+    int bf = avl_height(n->cfs_left) - avl_height(n->cfs_right);
+    if (bf > 1) {
+        if (avl_height(n->cfs_left->cfs_left) < avl_height(n->cfs_left->cfs_right))
+            n->cfs_left = avl_rotate_left(n->cfs_left);
+        return avl_rotate_right(n);
+    }
+    if (bf < -1) {
+        if (avl_height(n->cfs_right->cfs_right) < avl_height(n->cfs_right->cfs_left))
+            n->cfs_right = avl_rotate_right(n->cfs_right);
+        return avl_rotate_left(n);
+    }
+    return n;
+}
+
+static struct proc *avl_insert(struct proc *n, struct proc *p) {
+    if (n == 0) {
+        p->cfs_left = p->cfs_right = 0;
+        p->cfs_height = 1;
+        return p;
+    }
+    if (cfs_less(p, n))
+        n->cfs_left = avl_insert(n->cfs_left, p);
+    else
+        n->cfs_right = avl_insert(n->cfs_right, p);
+    return avl_balance(n);
+}
+
+// 摘下子树中最小的节点放入 *min，返回新的子树根
+static struct proc *avl_remove_min(struct proc *n, struct proc **min) {
+    if (n->cfs_left == 0) {
+        *min = n;
+        return n->cfs_right;
+    }
+    n->cfs_left = avl_remove_min(n->cfs_left, min);
+    return avl_balance(n);
+}
+
+static struct proc *avl_remove(struct proc *n, struct proc *p) {
+    if (n == 0)
+        return 0;
+    if (n == p) {
+        if (n->cfs_left == 0)
+            return n->cfs_right;
+        if (n->cfs_right == 0)
+            return n->cfs_left;
+        struct proc *m;
+        struct proc *r = avl_remove_min(n->cfs_right, &m);
+        m->cfs_left = n->cfs_left;
+        m->cfs_right = r;
+        return avl_balance(m);
+    }
+    if (cfs_less(p, n))
+        n->cfs_left = avl_remove(n->cfs_left, p);
+    else
+        n->cfs_right = avl_remove(n->cfs_right, p);
+    return avl_balance(n);
+}
+
+static struct proc *avl_first(struct proc *n) {
+    while (n && n->cfs_left)
+        n = n->cfs_left;
+    return n;
+}
+
+// ---------------------------------------------------------------------------
+
+// 一个时间片对应的虚拟运行时间 (nice 0 进程的实际运行时间)
+static uint64 cfs_granularity(void) {
+    int q = sched_get_quantum();
+    return machine.timebase / TICK_HZ * (q > 0 ? q : 1);
+}
+
+// 树变化后更新 leftmost，调用者持有队列锁。min_vruntime 不在这里推进：
+// 正在运行的进程不在树中，它的 vruntime 可能比树中所有进程都小
+static void cfs_update_leftmost(struct cfs_rq *cfs) {
+    struct proc *first = avl_first(cfs->root);
+    if (first)
+        cfs->leftmost = first->vruntime;
+}
+
+// 把 min_vruntime 推进到 v (只增不减)。记账时不持队列锁，
+// 可能与其他 CPU 上的入队、迁移并发，用 CAS 保证单调
+static void cfs_raise_min(struct cfs_rq *cfs, uint64 v) {
+    uint64 old = __atomic_load_n(&cfs->min_vruntime, __ATOMIC_RELAXED);
+    while (v > old &&
+           !__atomic_compare_exchange_n(&cfs->min_vruntime, &old, v, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void cfs_init(struct runq *rq) {
+    rq->cfs.root = 0;
+    rq->cfs.min_vruntime = 0;
+    rq->cfs.leftmost = 0;
+}
+
+static void cfs_enqueue(struct runq *rq, struct proc *p) {
+    struct cfs_rq *cfs = &rq->cfs;
+    // 睡眠很久的进程最多领先半个调度周期，不能凭积攒的 vruntime 长期独占 CPU
+    uint64 bonus = cfs_granularity() * CFS_LATENCY_TICKS / 2;
+    uint64 floor = cfs->min_vruntime > bonus ? cfs->min_vruntime - bonus : 0;
+    if (p->vruntime < floor)
+        p->vruntime = floor;
+    cfs->root = avl_insert(cfs->root, p);
+    cfs_update_leftmost(cfs);
+}
+
+// 摘下 vruntime 最小且允许在 cpu 上运行的进程：中序遍历跳过绑定在
+// 其他 CPU 上的进程，本地队列中的进程总是可以运行，不会走到后面
+static struct proc *cfs_dequeue(struct runq *rq, int cpu) {
+    struct cfs_rq *cfs = &rq->cfs;
+    struct proc *stack[CFS_MAX_DEPTH];
+    int top = 0;
+    struct proc *n = cfs->root, *p = 0;
+
+    while (n || top > 0) {
+        while (n) {
+            stack[top++] = n;
+            n = n->cfs_left;
+        }
+        n = stack[--top];
+        if (cpu < 0 || n->allowed_cpu < 0 || n->allowed_cpu == cpu) {
+            p = n;
+            break;
+        }
+        n = n->cfs_right;
+    }
+    if (p == 0)
+        return 0;
+    cfs->root = avl_remove(cfs->root, p);
+    p->cfs_left = p->cfs_right = 0;
+    cfs_update_leftmost(cfs);
+    return p;
+}
+
+// 给运行中的 p 记账，并把 min_vruntime 推进到 min(p, 树中最小者)。
+// 树为空时只看 p：单独运行的进程也要带着基准前进，否则之后入队的进程
+// 以陈旧的基准定位，会领先 p 它单独运行的全部时间
+static void cfs_account(struct runq *rq, struct proc *p, uint64 delta) {
+    struct cfs_rq *cfs = &rq->cfs;
+    p->vruntime += delta * NICE_0_LOAD / cfs_weight(p);
+    uint64 v = p->vruntime;
+    if (__atomic_load_n(&cfs->root, __ATOMIC_RELAXED) != 0) {
+        uint64 left = __atomic_load_n(&cfs->leftmost, __ATOMIC_RELAXED);
+        if (left < v)
+            v = left;
+    }
+    cfs_raise_min(cfs, v);
+}
+
+// 各队列的 min_vruntime 互不相关，迁移时保持进程相对于队列基准的位置
+static void cfs_migrate(struct proc *p, struct runq *from, struct runq *to) {
+    long rel = (long)(p->vruntime - from->cfs.min_vruntime);
+    if (rel < 0 && (uint64)-rel > to->cfs.min_vruntime)
+        p->vruntime = 0;
+    else
+        p->vruntime = to->cfs.min_vruntime + rel;
+}
+
+// 当前进程的 vruntime 超过树中最小者一个时间片以上时让出 CPU
+static int cfs_tick(struct runq *rq, struct proc *p) {
+    if (p == 0 || sched_get_quantum() == 0 || rq->nr == 0)
+        return 0;
+    return p->vruntime > rq->cfs.leftmost + cfs_granularity();
+}
+
+// 权重由 nice 值实时计算，vruntime 不变，树中的位置不需要调整
+static void cfs_reprio(struct runq *rq, struct proc *p) {
+}
+
+static void cfs_dump(struct runq *rq) {
+    printf("min_vruntime=%lu", rq->cfs.min_vruntime);
+}
+
+const struct sched_class cfs_sched_class = {
+    .name = "cfs",
+    .init = cfs_init,
+    .enqueue = cfs_enqueue,
+    .dequeue = cfs_dequeue,
+    .account = cfs_account,
+    .migrate = cfs_migrate,
+    .tick = cfs_tick,
+    .reprio = cfs_reprio,
+    .dump = cfs_dump,
+};
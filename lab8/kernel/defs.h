@@ -10,6 +10,8 @@
 #include "file.h"
 #include "stat.h"
 #include "klog.h"
+#include "slab.h"
+#include "fdt.h"
 
 // console.c
 void cons_putc(char c);
@@ -17,6 +19,7 @@ int consolewrite(int user_src, uint64 src, int n);
 int consoleread(int user_dst, uint64 dst, int n);
 
 // printf.c
+void printfinit(void);
 void printf(const char *fmt, ...);
 void clear_screen();
 void panic(const char *msg);
@@ -24,11 +27,51 @@ void panic(const char *msg);
 // uart.c
 void uart_putc(char c);
 
+// sched.c
+void runq_init(void);
+void runq_add(struct proc *p);
+struct proc *runq_take(void);
+void runq_reprio(struct proc *p);
+int runq_total(void);
+void runq_level_lengths(int *nr);
+void sched_start(struct proc *p);
+void sched_stop(struct proc *p);
+int sched_set_policy(const char *name);
+const char *sched_policy_name(void);
+int sched_tick(void);
+void sched_set_quantum(int ticks);
+int sched_get_quantum(void);
+void sched_dump_stats(void);
+
+// cfs.c
+void sched_group_init(void);
+void sched_group_join(struct proc *p, int gid);
+void sched_group_leave(struct proc *p);
+void sched_group_renice(struct proc *p, int nice);
+int sched_group_set_weight(int gid, int weight);
+
+// edf.c
+int sched_setdeadline(int runtime, int deadline, int period);
+int sched_dl_yield(void);
+void sched_dl_leave(struct proc *p);
+uint64 sched_dl_misses(void);
+
 // kalloc.c
 void kinit();
 void freerange(void *pa_start, void *pa_end);
 void kfree(void *pa);
 void *kalloc(void);
+void *kalloc_zeroed(void);
+void *kalloc_nozero(void);
+void kzero_task(void);
+int kalloc_zpool_count(void);
+void *kalloc_pages(int order);
+void *kalloc_pages_nozero(int order);
+void kfree_pages(void *pa, int order);
+uint64 kfreemem(void);
+uint64 kalloc_free_blocks(int order);
+void kalloc_dump_stats(void);
+void kalloc_dump_buddy(void);
 
 // vm.c
 void kvminit(void);
@@ -36,6 +79,11 @@ void kvminithart(void);
 pagetable_t create_pagetable(void);
 int map_page(pagetable_t pt, uint64 va, uint64 pa, int perm);
 pte_t *walk_lookup(pagetable_t pt, uint64 va);
+int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm);
+pagetable_t kvmmake(int max_level);
+void freewalk(pagetable_t pagetable);
+uint64 vm_ptpages(pagetable_t pagetable);
+void vm_dump_stats(const char *name, pagetable_t pagetable);
 
 // trap.c
 void trap_init(void);
@@ -43,7 +91,27 @@ void clock_init(void);
 uint64 get_time(void);
 uint64 get_interrupt_count(void);
 uint64 get_ticks(void);
-void* get_ticks_channel(void);
+uint64 clock_tick_time(uint64 tick);
+void clock_kick(uint64 when);
+int  cpu_kick(int cpu);
+void clock_resume(void);
+int clock_dynamic(void);
+int clock_set_sstc(int on);
+uint64 clock_rearm_cycles(int n);
+uint64 clock_timer_irqs(void);
+void clock_dump_stats(void);
+
+// timer.c
+void timer_init(void);
+void timer_add(struct timer *t, uint64 expires, void (*fn)(void *), void *arg);
+void hrtimer_add(struct timer *t, uint64 when, void (*fn)(void *), void *arg);
+int  timer_del(struct timer *t);
+void timer_interrupt(void);
+uint64 timer_deadline(void);
+void sleep_until(uint64 tick);
+void sleep_ticks(uint64 n);
+void sleep_ns(uint64 ns);
+void timer_dump_stats(void);
 
 // proc.c
 int  fork(void);           
@@ -51,12 +119,21 @@ void exit(int);
 int  wait(int*);
 void sleep(void*, struct spinlock*);
 void wakeup(void*);
+int  wakeup_one(void*);
 void yield(void);
+void switch_finish(void);
+int  sched_set_direct(int on);
+void preempt(void);
+int setpriority(int pid, int nice);
+void pi_set_nice(struct proc *p, int nice);
+int setgroup(int pid, int gid);
+int setaffinity(int pid, int cpu);
 int  create_process(void (*entry)(void));
 void procinit(void);
 void scheduler(void) __attribute__((noreturn));
 struct proc* myproc(void);
 struct cpu* mycpu(void);
+int cpuid(void);
 void wait_process(int*);
 
 // [修复] 必须在这里声明调试接口，test.c 才能看见它
@@ -111,15 +188,31 @@ void swtch(struct context *old, struct context *new);
 // spinlock.c
 void spinlock_init(struct spinlock *lk, char *name);
 void acquire(struct spinlock *lk);
+void spinlock_init_type(struct spinlock *lk, char *name, int type);
+int  tryacquire(struct spinlock *lk);
 void release(struct spinlock *lk);
 void push_off(void);
 void pop_off(void);
 
+// lockstat.c (make LOCKSTAT=1)
+struct lockstat *lockstat_class(char *name, int sleep);
+void lockstat_acquired(struct lockstat *ls, uint64 pc, int contended, uint64 wait);
+void lockstat_released(struct lockstat *ls, uint64 hold);
+void lockstat_dump(void);
+void lockstat_reset(void);
+
 // sleeplock.c
 void initsleeplock(struct sleeplock *lk, char *name);
 void acquiresleep(struct sleeplock *lk);
 void releasesleep(struct sleeplock *lk);
+void acquiresleep_shared(struct sleeplock *lk);
+void releasesleep_shared(struct sleeplock *lk);
+void downgradesleep(struct sleeplock *lk);
 int holdingsleep(struct sleeplock *lk);
+int  sleeplock_set_spin(int on);
+int  sleeplock_set_pi(int on);
+uint64 sleeplock_boosted_waits(void);
+void sleeplock_dump_stats(void);
 
 // bio.c
 void binit(void);
@@ -145,6 +238,9 @@ void iupdate(struct inode *);
 struct inode *idup(struct inode *);
 void ilock(struct inode *);
 void iunlock(struct inode *);
+void ilock_shared(struct inode *);
+void iunlock_shared(struct inode *);
+int  ilock_set_shared(int on);
 void iput(struct inode *);
 void iunlockput(struct inode *);
 int readi(struct inode *, int, uint64, uint, uint);
@@ -184,6 +280,14 @@ void run_lab5_tests(void);
 void run_lab6_tests(void); 
 void run_lab7_tests(void);
 void run_lab8_tests(void);
+void run_perf_tests(void);
+int  stub_fork(void);
+int  stub_wait(int *status);
+void stub_exit(int status);
+int  stub_setaffinity(int pid, int cpu);
+
+// bench.c
+void run_sched_bench(void);
 
 // klog.c
 int klog_read(uint64 dst, int max_len);
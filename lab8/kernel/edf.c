@@ -0,0 +1,210 @@
+// kernel/edf.c
+// EDF 实时调度类：周期任务用 (runtime, deadline, period) 描述，每个周期
+// 释放一个作业，作业最多占用 runtime 的 CPU 时间，必须在周期开始后
+// deadline 个节拍内完成 (调用 dl_yield)。实时进程优先于普通调度类，
+// 同一 CPU 上截止时间最早的先运行。
+//
+// 采用分区 EDF：准入时按利用率 runtime/period 首次适配到一个 CPU，
+// 每个 CPU 上实时任务的利用率之和不超过 EDF_MAX_UTIL，单 CPU 上的 EDF
+// 在利用率不超过 100% 时可以满足所有截止时间。实时进程不会被窃取。
+// 作业用完预算后本周期余下的时间回到普通调度类运行，不会饿死其他进程。
+//
+// 作业在截止时间之后才完成，或到下一个周期开始还没完成，都记一次错过截止时间。
+#include "defs.h"
+#include "sched.h"
+
+#define EDF_MAX_UTIL 900        // 每个 CPU 上实时任务的利用率上限 (千分比)
+
+static struct spinlock edf_lock;    // 保护 cpu_util
+static int cpu_util[NCPU];
+static uint64 nr_misses;
+
+void edf_init(void) {
+    spinlock_init(&edf_lock, "edf");
+    for (int i = 0; i < NCPU; i++) {
+        cpu_util[i] = 0;
+    }
+}
+
+static uint64 tick_time(void) {
+    return machine.timebase / TICK_HZ;
+}
+
+// 当前作业错过了截止时间，每个作业只记一次
+static void edf_miss(struct proc *p) {
+    if (!p->dl_missed) {
+        p->dl_missed = 1;
+        p->dl_misses++;
+        __atomic_fetch_add(&nr_misses, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// 到了下一个周期就释放新作业：补满预算并设置新的截止时间。
+// 跳过的周期 (进程长时间没有运行) 不再补作业。调用者独占访问 p 的调度字段
+static void edf_replenish(struct proc *p, uint64 now) {
+    if (now < p->dl_period_end)
+        return;
+    if (!p->dl_done)
+        edf_miss(p);
+    uint64 release = now - (now - p->dl_period_end) % p->dl_period;
+    p->dl_deadline = release + p->dl_rel_deadline;
+    p->dl_period_end = release + p->dl_period;
+    p->dl_budget = p->dl_runtime * tick_time();
+    p->dl_done = 0;
+    p->dl_missed = 0;
+}
+
+// 入队时决定进程属于哪个调度类：有预算的实时进程进入 EDF 队列
+int edf_eligible(struct proc *p) {
+    if (p->dl_runtime == 0)
+        return 0;
+    edf_replenish(p, get_ticks());
+    return !p->dl_done && p->dl_budget > 0;
+}
+
+static void edf_init_rq(struct runq *rq) {
+    rq->edf.head = 0;
+    rq->edf.nr = 0;
+}
+
+// 按截止时间有序插入，截止时间相同时先来先服务。实时进程不多，线性插入即可
+static void edf_enqueue(struct runq *rq, struct proc *p) {
+    struct proc **pp = &rq->edf.head;
+    while (*pp && (*pp)->dl_deadline <= p->dl_deadline)
+        pp = &(*pp)->rq_next;
+    p->rq_next = *pp;
+    *pp = p;
+    rq->edf.nr++;
+}
+
+// 实时进程固定在准入时分配的 CPU 上，cpu 为 -1 时不检查
+static struct proc *edf_dequeue(struct runq *rq, int cpu) {
+    struct proc *p = rq->edf.head;
+    if (p == 0 || (cpu >= 0 && p->dl_cpu != cpu))
+        return 0;
+    rq->edf.head = p->rq_next;
+    p->rq_next = 0;
+    rq->edf.nr--;
+    return p;
+}
+
+static void edf_account(struct runq *rq, struct proc *p, uint64 delta) {
+    p->dl_budget = delta < p->dl_budget ? p->dl_budget - delta : 0;
+}
+
+static void edf_migrate(struct proc *p, struct runq *from, struct runq *to) {
+}
+
+// 预算用完、跨入了下一个周期，或本地出现截止时间更早的作业时抢占
+static int edf_tick(struct runq *rq, struct proc *p) {
+    uint64 now = get_ticks();
+    if (now >= p->dl_period_end)
+        return 1;
+    if (now > p->dl_deadline)
+        edf_miss(p);
+    if (p->dl_budget == 0)
+        return 1;
+    struct proc *first = rq->edf.head;
+    return first && first->dl_deadline < p->dl_deadline;
+}
+
+static void edf_dump(struct runq *rq) {
+    printf("edf=%d ", rq->edf.nr);
+}
+
+const struct sched_class edf_sched_class = {
+    .name = "edf",
+    .init = edf_init_rq,
+    .enqueue = edf_enqueue,
+    .dequeue = edf_dequeue,
+    .account = edf_account,
+    .migrate = edf_migrate,
+    .tick = edf_tick,
+    .dump = edf_dump,
+};
+
+// 释放进程占用的实时利用率，调用者持有 edf_lock
+static void edf_release_util(struct proc *p) {
+    if (p->dl_runtime) {
+        cpu_util[p->dl_cpu] -= p->dl_util;
+        p->dl_runtime = 0;
+        p->dl_util = 0;
+    }
+}
+
+// 把当前进程设为周期实时任务 (参数单位为节拍，runtime 为 0 时恢复为普通进程)。
+// 准入控制失败返回 -1。从下一次入队开始生效，返回前让出 CPU 以迁到分配的 CPU 上
+int sched_setdeadline(int runtime, int deadline, int period) {
+    struct proc *p = myproc();
+    if (runtime < 0 || (runtime > 0 && (runtime > deadline || deadline > period)))
+        return -1;
+
+    int util = runtime > 0 ? runtime * 1000 / period : 0;
+    if (runtime > 0 && util == 0)
+        util = 1;
+    int cpu = -1;
+
+    acquire(&edf_lock);
+    int old_cpu = p->dl_runtime ? p->dl_cpu : -1;
+    int old_util = p->dl_util;
+    for (int i = 0; runtime > 0 && i < machine.ncpu; i++) {
+        int used = cpu_util[i] - (i == old_cpu ? old_util : 0);
+        if (used + util <= EDF_MAX_UTIL) {
+            cpu = i;
+            break;
+        }
+    }
+    if (runtime > 0 && cpu < 0) {
+        release(&edf_lock);
+        return -1;
+    }
+    // 进程正在本 CPU 上运行，关中断 (持有 p->lock) 后时钟中断不会看到一半的参数
+    acquire(&p->lock);
+    edf_release_util(p);
+    if (runtime > 0) {
+        cpu_util[cpu] += util;
+        p->dl_util = util;
+        p->dl_cpu = cpu;
+        p->dl_rel_deadline = deadline;
+        p->dl_period = period;
+        p->dl_period_end = get_ticks();
+        p->dl_done = 1;         // 第一个周期从下次入队开始，不算错过
+        p->dl_runtime = runtime;
+    }
+    release(&p->lock);
+    release(&edf_lock);
+
+    yield();
+    return 0;
+}
+
+// 当前作业完成，睡眠到下一个周期开始
+int sched_dl_yield(void) {
+    struct proc *p = myproc();
+    if (p->dl_runtime == 0)
+        return -1;
+
+    acquire(&p->lock);
+    if (get_ticks() > p->dl_deadline)
+        edf_miss(p);
+    p->dl_done = 1;
+    p->dl_jobs++;
+    uint64 next = p->dl_period_end;
+    release(&p->lock);
+    // 在下一个周期开始时被唤醒一次，唤醒时的入队就释放了新作业
+    sleep_until(next);
+    return 0;
+}
+
+// 进程退出时归还实时利用率
+void sched_dl_leave(struct proc *p) {
+    if (p->dl_runtime == 0)
+        return;
+    acquire(&edf_lock);
+    edf_release_util(p);
+    release(&edf_lock);
+}
+
+uint64 sched_dl_misses(void) {
+    return nr_misses;
+}
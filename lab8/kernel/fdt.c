@@ -0,0 +1,276 @@
+// kernel/fdt.c
+// 扁平设备树 (FDT) 解析：OpenSBI 通过 a1 传入设备树地址，
+// 启动时从中读出内存大小、hart 列表、timebase、virtio-mmio 设备和 bootargs
+#include "defs.h"
+#include "fdt.h"
+
+#define FDT_MAGIC       0xd00dfeed
+#define FDT_BEGIN_NODE  1
+#define FDT_END_NODE    2
+#define FDT_PROP        3
+#define FDT_NOP         4
+#define FDT_END         9
+
+#define FDT_MAX_DEPTH   16
+
+// 无设备树时的默认配置 (QEMU virt, -m 128M, 单核)
+#define DEFAULT_MEM_TOP 0x88000000L
+#define DEFAULT_VIRTIO  0x10001000L
+
+// 设备树头部，所有字段均为大端序
+struct fdt_header {
+    uint32 magic;
+    uint32 totalsize;
+    uint32 off_dt_struct;
+    uint32 off_dt_strings;
+    uint32 off_mem_rsvmap;
+    uint32 version;
+    uint32 last_comp_version;
+    uint32 boot_cpuid_phys;
+    uint32 size_dt_strings;
+    uint32 size_dt_struct;
+};
+
+struct machine_info machine;
+
+static uint32 be32(const void *p) {
+    const uchar *b = p;
+    return ((uint32)b[0] << 24) | ((uint32)b[1] << 16) | ((uint32)b[2] << 8) | b[3];
+}
+
+// 读取 cells 个 32 位单元组成的数
+static uint64 read_cells(const uchar *p, int cells) {
+    uint64 v = 0;
+    for (int i = 0; i < cells; i++) {
+        v = (v << 32) | be32(p + 4 * i);
+    }
+    return v;
+}
+
+static int str_eq(const char *a, const char *b) {
+    return strncmp(a, b, 64) == 0;
+}
+
+static int str_prefix(const char *s, const char *prefix) {
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+// riscv,isa 字符串 (如 rv64imafdch_zicsr_sstc) 中是否有某个多字母扩展
+static int isa_has_ext(const char *isa, int len, const char *ext) {
+    int elen = strlen(ext);
+    for (int i = 0; i + 1 + elen < len && isa[i]; i++) {
+        if (isa[i] == '_' && strncmp(isa + i + 1, ext, elen) == 0 &&
+            (isa[i + 1 + elen] == '_' || isa[i + 1 + elen] == 0))
+            return 1;
+    }
+    return 0;
+}
+
+static void set_defaults(uint64 hartid) {
+    machine.from_fdt = 0;
+    machine.dtb_base = 0;
+    machine.dtb_size = 0;
+    machine.mem_base = KERNBASE;
+    machine.mem_top = DEFAULT_MEM_TOP;
+    machine.boot_hartid = hartid;
+    machine.ncpu = 1;
+    machine.hartid[0] = hartid;
+    machine.timebase = TIMEBASE_HZ;
+    machine.sstc = 0;
+    machine.nvirtio = 1;
+    machine.virtio_base[0] = DEFAULT_VIRTIO;
+    machine.bootargs[0] = 0;
+}
+
+// 解析一个属性；depth 是属性所属节点的深度 (根节点为 1)
+static void fdt_prop(char **names, int depth, int *addr_cells, int *size_cells,
+                     const char *pname, const uchar *val, int len,
+                     int *nmem, int *ncpu, int *nvirtio, int *nisa, int *nsstc) {
+    const char *node = names[depth];
+
+    // 这两个属性描述的是子节点 reg 的格式
+    if (str_eq(pname, "#address-cells") && len == 4) {
+        addr_cells[depth] = be32(val);
+        return;
+    }
+    if (str_eq(pname, "#size-cells") && len == 4) {
+        size_cells[depth] = be32(val);
+        return;
+    }
+
+    int ac = addr_cells[depth - 1];
+    int sc = size_cells[depth - 1];
+
+    // /memory@...: 可能有多段，取包含内核的那一段
+    if (depth == 2 && str_prefix(node, "memory") && str_eq(pname, "reg")) {
+        for (int off = 0; off + 4 * (ac + sc) <= len; off += 4 * (ac + sc)) {
+            uint64 base = read_cells(val + off, ac);
+            uint64 size = read_cells(val + off + 4 * ac, sc);
+            if (base <= KERNBASE && KERNBASE < base + size) {
+                machine.mem_base = base;
+                machine.mem_top = base + size;
+                (*nmem)++;
+            }
+        }
+        return;
+    }
+
+    // /cpus/timebase-frequency
+    if (depth == 2 && str_eq(node, "cpus") && str_eq(pname, "timebase-frequency")) {
+        machine.timebase = read_cells(val, len / 4 > 2 ? 2 : len / 4);
+        return;
+    }
+
+    // /cpus/cpu@N/reg 是 hart id
+    if (depth == 3 && str_eq(names[2], "cpus") && str_prefix(node, "cpu@") && str_eq(pname, "reg")) {
+        if (*ncpu < NCPU) {
+            machine.hartid[*ncpu] = read_cells(val, ac);
+        } else {
+            printf("fdt: more than NCPU=%d harts, ignoring hart %lu\n", NCPU, read_cells(val, ac));
+        }
+        (*ncpu)++;
+        return;
+    }
+
+    // /cpus/cpu@N/riscv,isa：只有所有 hart 都支持时才使用 Sstc
+    if (depth == 3 && str_eq(names[2], "cpus") && str_prefix(node, "cpu@") && str_eq(pname, "riscv,isa")) {
+        (*nisa)++;
+        if (isa_has_ext((const char*)val, len, "sstc"))
+            (*nsstc)++;
+        return;
+    }
+
+    // virtio_mmio@...: 每个 slot 一页寄存器
+    if (str_prefix(node, "virtio_mmio@") && str_eq(pname, "reg")) {
+        if (*nvirtio < FDT_MAX_VIRTIO) {
+            machine.virtio_base[(*nvirtio)++] = read_cells(val, ac);
+        }
+        return;
+    }
+
+    // /chosen/bootargs
+    if (depth == 2 && str_eq(node, "chosen") && str_eq(pname, "bootargs")) {
+        int n = len < BOOTARGS_MAX ? len : BOOTARGS_MAX;
+        safestrcpy(machine.bootargs, (const char*)val, n);
+        return;
+    }
+}
+
+void fdt_init(uint64 hartid, uint64 dtb) {
+    set_defaults(hartid);
+
+    struct fdt_header *h = (struct fdt_header*)dtb;
+    if (dtb == 0 || be32(&h->magic) != FDT_MAGIC) {
+        printf("fdt: no device tree at %p, using defaults\n", dtb);
+        return;
+    }
+
+    const uchar *structs = (const uchar*)dtb + be32(&h->off_dt_struct);
+    const char *strings = (const char*)dtb + be32(&h->off_dt_strings);
+    const uchar *p = structs;
+    const uchar *struct_end = structs + be32(&h->size_dt_struct);
+
+    char *names[FDT_MAX_DEPTH];
+    int addr_cells[FDT_MAX_DEPTH];
+    int size_cells[FDT_MAX_DEPTH];
+    int depth = 0;
+    int nmem = 0, ncpu = 0, nvirtio = 0, nisa = 0, nsstc = 0;
+
+    addr_cells[0] = 2;
+    size_cells[0] = 1;
+    names[0] = "";
+
+    while (p < struct_end) {
+        uint32 token = be32(p);
+        p += 4;
+        if (token == FDT_BEGIN_NODE) {
+            const char *name = (const char*)p;
+            p += (strlen(name) + 1 + 3) & ~3;
+            if (++depth >= FDT_MAX_DEPTH) {
+                panic("fdt: device tree too deep");
+            }
+            names[depth] = (char*)name;
+            // 规范规定的缺省值
+            addr_cells[depth] = 2;
+            size_cells[depth] = 1;
+        } else if (token == FDT_END_NODE) {
+            depth--;
+        } else if (token == FDT_PROP) {
+            int len = be32(p);
+            const char *pname = strings + be32(p + 4);
+            const uchar *val = p + 8;
+            p += 8 + ((len + 3) & ~3);
+            if (depth > 0) {
+                fdt_prop(names, depth, addr_cells, size_cells, pname, val, len,
+                         &nmem, &ncpu, &nvirtio, &nisa, &nsstc);
+            }
+        } else if (token == FDT_NOP) {
+            continue;
+        } else if (token == FDT_END) {
+            break;
+        } else {
+            printf("fdt: bad token 0x%x, stop parsing\n", token);
+            break;
+        }
+    }
+
+    machine.from_fdt = 1;
+    machine.dtb_base = dtb;
+    machine.dtb_size = be32(&h->totalsize);
+    if (ncpu > 0) {
+        machine.ncpu = ncpu < NCPU ? ncpu : NCPU;
+    }
+    if (nvirtio > 0) {
+        machine.nvirtio = nvirtio;
+    }
+    machine.sstc = nisa > 0 && nsstc == nisa;
+    // 约定 CPU 0 是启动 hart，其余 hart 按设备树中的顺序排列
+    for (int i = 1; i < machine.ncpu; i++) {
+        if (machine.hartid[i] == hartid) {
+            machine.hartid[i] = machine.hartid[0];
+            machine.hartid[0] = hartid;
+        }
+    }
+    if (nmem == 0) {
+        printf("fdt: no memory node covers the kernel, assuming %p\n", DEFAULT_MEM_TOP);
+    }
+    fdt_dump();
+}
+
+void fdt_dump(void) {
+    printf("fdt: %s, dtb=%p size=%lu\n", machine.from_fdt ? "parsed" : "defaults",
+           machine.dtb_base, machine.dtb_size);
+    printf("  memory: %p - %p (%lu MB)\n", machine.mem_base, machine.mem_top,
+           (machine.mem_top - machine.mem_base) >> 20);
+    printf("  harts: %d (boot hart %lu), timebase %lu Hz%s\n",
+           machine.ncpu, machine.boot_hartid, machine.timebase, machine.sstc ? ", sstc" : "");
+    for (int i = 0; i < machine.nvirtio; i++) {
+        printf("  virtio-mmio slot %d: %p\n", i, machine.virtio_base[i]);
+    }
+    if (machine.bootargs[0]) {
+        printf("  bootargs: %s\n", machine.bootargs);
+    }
+}
+
+// 在 bootargs 中查找 key=value 形式的参数，把 value 复制到 buf；
+// 返回 value 的长度，没有该参数时返回 -1
+int fdt_bootarg(const char *key, char *buf, int n) {
+    int klen = strlen(key);
+    const char *s = machine.bootargs;
+    while (*s) {
+        while (*s == ' ')
+            s++;
+        const char *tok = s;
+        while (*s && *s != ' ')
+            s++;
+        if (s - tok > klen && strncmp(tok, key, klen) == 0 && tok[klen] == '=') {
+            int len = s - tok - klen - 1;
+            if (len > n - 1)
+                len = n - 1;
+            memmove(buf, tok + klen + 1, len);
+            buf[len] = 0;
+            return len;
+        }
+    }
+    return -1;
+}
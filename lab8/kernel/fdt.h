@@ -0,0 +1,33 @@
+#ifndef __FDT_H__
+#define __FDT_H__
+
+#include "riscv.h"
+#include "param.h"
+
+#define FDT_MAX_VIRTIO  8
+#define BOOTARGS_MAX    128
+
+// 从设备树 (FDT) 中得到的机器配置；没有设备树时使用 QEMU virt 的默认值
+struct machine_info {
+    int from_fdt;               // 是否成功解析了设备树
+    uint64 dtb_base;            // 设备树所在物理内存，需要从分配器中保留
+    uint64 dtb_size;
+    uint64 mem_base;            // 包含内核的那段 DRAM
+    uint64 mem_top;
+    uint64 boot_hartid;         // 执行 _start 的 hart
+    int ncpu;                   // 可用 hart 数 (不超过 NCPU)
+    uint64 hartid[NCPU];
+    uint64 timebase;            // time CSR 频率 (Hz)
+    int sstc;                   // 所有 hart 都支持 Sstc (可直接写 stimecmp)
+    int nvirtio;
+    uint64 virtio_base[FDT_MAX_VIRTIO];
+    char bootargs[BOOTARGS_MAX];
+};
+
+extern struct machine_info machine;
+
+void fdt_init(uint64 hartid, uint64 dtb);
+void fdt_dump(void);
+int fdt_bootarg(const char *key, char *buf, int n);
+
+#endif // __FDT_H__
@@ -9,28 +9,27 @@ struct devsw devsw[NDEV];
 extern int consolewrite(int, uint64, int);
 extern int consoleread(int, uint64, int);
 
+// 打开文件对象来自 slab 缓存，数量只受内存限制；lock 保护引用计数
 struct {
     struct spinlock lock;
-    struct file file[NFILE];
+    struct kmem_cache *cache;
 } ftable;
 
 void fileinit(void) {
-    spinlock_init(&ftable.lock, "ftable");
+    spinlock_init_type(&ftable.lock, "ftable", SPIN_TICKET);
+    ftable.cache = kmem_cache_create("file", sizeof(struct file), 0, 0);
     devsw[CONSOLE].write = consolewrite;
     devsw[CONSOLE].read = consoleread;
 }
 
 struct file *filealloc(void) {
-    acquire(&ftable.lock);
-    for (struct file *f = ftable.file; f < ftable.file + NFILE; f++) {
-        if (f->ref == 0) {
-            f->ref = 1;
-            release(&ftable.lock);
-            return f;
-        }
+    struct file *f = kmem_cache_alloc(ftable.cache);
+    if (f == 0) {
+        return 0;
     }
-    release(&ftable.lock);
-    return 0;
+    memset(f, 0, sizeof(*f));
+    f->ref = 1;
+    return f;
 }
 
 struct file *filedup(struct file *f) {
@@ -63,12 +62,7 @@ void fileclose(struct file *f) {
         end_op();
     }
 
-    f->type = FD_NONE;
-    f->readable = 0;
-    f->writable = 0;
-    f->ip = 0;
-    f->off = 0;
-    f->major = 0;
+    kmem_cache_free(ftable.cache, f);
 }
 
 int filestat(struct file *f, uint64 addr) {
@@ -76,9 +70,9 @@ int filestat(struct file *f, uint64 addr) {
         return -1;
     }
     struct stat *st = (struct stat*)addr;
-    ilock(f->ip);
+    ilock_shared(f->ip);
     stati(f->ip, st);
-    iunlock(f->ip);
+    iunlock_shared(f->ip);
     return 0;
 }
 
@@ -87,12 +81,21 @@ int fileread(struct file *f, uint64 addr, int n) {
         return -1;
     }
     if (f->type == FD_INODE) {
-        ilock(f->ip);
+        // 只有一个描述符引用这个 file 时，别人不会同时修改 f->off，
+        // 可以和其他 file 上的读者共享 inode 锁；否则仍由 inode 锁保护 f->off
+        int shared = f->ref == 1;
+        if (shared)
+            ilock_shared(f->ip);
+        else
+            ilock(f->ip);
         int r = readi(f->ip, 0, addr, f->off, n);
         if (r > 0) {
             f->off += r;
         }
-        iunlock(f->ip);
+        if (shared)
+            iunlock_shared(f->ip);
+        else
+            iunlock(f->ip);
         return r;
     } else if (f->type == FD_DEVICE) {
         if (f->major < 0 || f->major >= NDEV || !devsw[f->major].read) {
@@ -10,11 +10,25 @@
 
 struct superblock sb;
 
+// 内存 inode 来自 slab 缓存，按 (dev, inum) 散列；引用计数归零即释放
+#define NIHASH 64
+
 struct {
     struct spinlock lock;
-    struct inode inode[NINODE];
+    struct kmem_cache *cache;
+    struct inode *hash[NIHASH];
 } icache;
 
+static inline struct inode **ihash_bucket(uint dev, uint inum) {
+    return &icache.hash[(dev * 31 + inum) % NIHASH];
+}
+
+static void inode_ctor(void *obj) {
+    struct inode *ip = (struct inode*)obj;
+    memset(ip, 0, sizeof(*ip));
+    initsleeplock(&ip->lock, "inode");
+}
+
 static void readsb(int dev, struct superblock *sb);
 static void bzero(int dev, int bno);
 static uint balloc(uint dev);
@@ -85,33 +99,34 @@ void iinit(void) {
         fs_format(ROOTDEV);
         readsb(ROOTDEV, &sb);
     }
-    spinlock_init(&icache.lock, "icache");
-    for (int i = 0; i < NINODE; i++) {
-        icache.inode[i].ref = 0;
-        initsleeplock(&icache.inode[i].lock, "inode");
+    spinlock_init_type(&icache.lock, "icache", SPIN_MCS);
+    icache.cache = kmem_cache_create("inode", sizeof(struct inode), 0, inode_ctor);
+    for (int i = 0; i < NIHASH; i++) {
+        icache.hash[i] = 0;
     }
     printf("fs: size=%d nblocks=%d ninodes=%d nlog=%d\n", sb.size, sb.nblocks, sb.ninodes, sb.nlog);
 }
 
 struct inode *iget(uint dev, uint inum) {
-    struct inode *ip, *empty = 0;
+    struct inode *ip;
+    struct inode **bucket = ihash_bucket(dev, inum);
     acquire(&icache.lock);
-    for (ip = icache.inode; ip < &icache.inode[NINODE]; ip++) {
-        if (ip->ref > 0 && ip->dev == dev && ip->inum == inum) {
+    for (ip = *bucket; ip; ip = ip->hnext) {
+        if (ip->dev == dev && ip->inum == inum) {
             ip->ref++;
             release(&icache.lock);
             return ip;
         }
-        if (empty == 0 && ip->ref == 0)
-            empty = ip;
     }
-    if (empty == 0)
+    ip = kmem_cache_alloc(icache.cache);
+    if (ip == 0)
         panic("iget: no inodes");
-    ip = empty;
     ip->dev = dev;
     ip->inum = inum;
     ip->ref = 1;
     ip->valid = 0;
+    ip->hnext = *bucket;
+    *bucket = ip;
     release(&icache.lock);
     return ip;
 }
@@ -166,6 +181,44 @@ void iunlock(struct inode *ip) {
     releasesleep(&ip->lock);
 }
 
+// 为 0 时 ilock_shared 退化为 ilock，用于对比
+static int ilock_shared_on = 1;
+
+// 共享地锁住 inode，供只读的路径 (readi、dirlookup、stati) 并发使用；
+// 修改 inode 或其内容 (writei、itrunc、dirlink) 仍然要 ilock。
+// 读路径不会分配块：size 以内的块都已由 writei 分配，bmap 不会改 addrs。
+// inode 还没从磁盘加载时先独占地加载，再降级为共享
+void ilock_shared(struct inode *ip) {
+    if (ip == 0 || ip->ref < 1)
+        panic("ilock_shared");
+    if (!ilock_shared_on) {
+        ilock(ip);
+        return;
+    }
+    acquiresleep_shared(&ip->lock);
+    if (ip->valid)
+        return;
+    releasesleep_shared(&ip->lock);
+    ilock(ip);
+    downgradesleep(&ip->lock);
+}
+
+void iunlock_shared(struct inode *ip) {
+    if (ip == 0)
+        panic("iunlock_shared");
+    if (holdingsleep(&ip->lock))
+        releasesleep(&ip->lock);    // ilock_shared 退化成了 ilock
+    else
+        releasesleep_shared(&ip->lock);
+}
+
+// 打开或关闭共享的 inode 锁，返回原来的设置
+int ilock_set_shared(int on) {
+    int old = ilock_shared_on;
+    ilock_shared_on = on;
+    return old;
+}
+
 void iupdate(struct inode *ip) {
     struct buf *bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     struct dinode *dip = (struct dinode*)bp->data + ip->inum % IPB;
@@ -190,6 +243,14 @@ void iput(struct inode *ip) {
     releasesleep(&ip->lock);
     acquire(&icache.lock);
     ip->ref--;
+    if (ip->ref == 0) {
+        struct inode **pp = ihash_bucket(ip->dev, ip->inum);
+        while (*pp != ip)
+            pp = &(*pp)->hnext;
+        *pp = ip->hnext;
+        ip->hnext = 0;
+        kmem_cache_free(icache.cache, ip);
+    }
     release(&icache.lock);
 }
 
@@ -367,21 +428,23 @@ struct inode *namex(char *path, int nameiparent, char *name) {
         ip = iget(ROOTDEV, ROOTINO);
     else
         ip = idup(myproc()->cwd);
+    // 只读目录，多个进程可以同时查找同一个目录 (如 /)
     while ((path = skipelem(path, name)) != 0) {
-        ilock(ip);
+        ilock_shared(ip);
         if (ip->type != T_DIR) {
-            iunlockput(ip);
+            iunlock_shared(ip);
+            iput(ip);
             return 0;
         }
         if (nameiparent && *path == '\0') {
-            iunlock(ip);
+            iunlock_shared(ip);
             return ip;
         }
-        if ((next = dirlookup(ip, name, 0)) == 0) {
-            iunlockput(ip);
+        next = dirlookup(ip, name, 0);
+        iunlock_shared(ip);
+        iput(ip);
+        if (next == 0)
             return 0;
-        }
-        iunlockput(ip);
         ip = next;
     }
     if (nameiparent) {
@@ -436,9 +499,8 @@ void get_superblock(struct superblock *dst) {
 void dump_inode_usage(void) {
     acquire(&icache.lock);
     printf("=== Inode Usage ===\n");
-    for (int i = 0; i < NINODE; i++) {
-        struct inode *ip = &icache.inode[i];
-        if (ip->ref > 0)
+    for (int i = 0; i < NIHASH; i++) {
+        for (struct inode *ip = icache.hash[i]; ip; ip = ip->hnext)
             printf("inum=%d ref=%d type=%d size=%d\n", ip->inum, ip->ref, ip->type, ip->size);
     }
     release(&icache.lock);
@@ -55,6 +55,7 @@ struct inode {
     int ref;
     struct sleeplock lock;
     int valid;
+    struct inode *hnext;    // icache 散列链，受 icache.lock 保护
 
     short type;
     short major;
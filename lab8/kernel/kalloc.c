@@ -6,18 +6,217 @@
 // 外部定义的内核结束地址
 extern char end[];
 
-// 空闲物理页链表的头节点
+// 每 CPU 缓存一次与全局池交换的页数，以及缓存页数上限
+#define KCACHE_BATCH 32
+#define KCACHE_HIGH  (KCACHE_BATCH * 4)
+
+// 预清零页池的目标页数与低水位：低于低水位时后台线程补充到目标值
+#define ZPOOL_TARGET 64
+#define ZPOOL_LOW    (ZPOOL_TARGET / 4)
+// 每 CPU 缓存一次从预清零页池取走的页数
+#define ZCACHE_BATCH 8
+
+// 页描述符：低 5 位记录块的阶，PG_FREE 表示该页是伙伴系统空闲块的首页
+#define PG_ORDER_MASK 0x1f
+#define PG_FREE       0x80
+
+// 空闲块链表的节点 (存放在空闲块首页内)
 struct run {
     struct run *next;
+    struct run *prev;
+};
+
+struct free_area {
+    struct run head;     // 双向循环链表哨兵，合并时可 O(1) 摘除伙伴块
+    uint64 nr_free;      // 该阶空闲块数
 };
-static struct run *freelist;
+
+// 全局伙伴系统：由自旋锁保护，只在批量补充/归还或多页分配时访问
+static struct {
+    struct spinlock lock;
+    struct free_area area[MAX_ORDER];
+    uchar *pginfo;       // 每个物理页一个字节的描述符，下标为页帧号
+    uint64 base_pfn;     // 第一个可分配页的页帧号
+    uint64 npages;       // pginfo 覆盖的页数 (KERNBASE 到物理内存顶部)
+    uint64 rsv_start;    // [rsv_start, rsv_end) 是设备树占用的页，永不分配
+    uint64 rsv_end;
+    uint64 frontier;     // [frontier, npages) 是从未分配过的页，按需切块挂入空闲链表
+    uint64 nfree;        // 空闲页总数 (含边界之上的页)
+} kmem;
+
+// 每 CPU 页缓存：kalloc()/kfree() 的常见路径只访问本 CPU 的数据，
+// 关中断即可保证独占，无需加锁
+struct kcache {
+    struct run *freelist;
+    int count;
+    uint64 refills;     // 从全局池批量补充的次数
+    uint64 drains;      // 向全局池批量归还的次数
+    struct run *zlist;  // 已清零的页，成批从预清零页池取来
+    int zcount;
+    uint64 zhits;       // 拿到已清零页的次数
+    uint64 zmisses;     // 只能现场清零的次数
+};
+static struct kcache kcaches[NCPU];
+
+// 预清零页池：由 kzero_task 在后台清零后放入，
+// kalloc_zeroed() 在本 CPU 的清零页用完时才来成批取用
+static struct {
+    struct spinlock lock;
+    struct run *freelist;
+    int count;
+    uint64 zeroed;       // 后台线程清零的页数
+} zpool;
+
+static inline uint64 pa2pfn(uint64 pa) {
+    return (pa - KERNBASE) >> PGSHIFT;
+}
+
+static inline void *pfn2pa(uint64 pfn) {
+    return (void*)(KERNBASE + (pfn << PGSHIFT));
+}
+
+static void area_push(int order, uint64 pfn) {
+    struct run *r = (struct run*)pfn2pa(pfn);
+    struct run *head = &kmem.area[order].head;
+    r->next = head->next;
+    r->prev = head;
+    head->next->prev = r;
+    head->next = r;
+    kmem.area[order].nr_free++;
+    kmem.pginfo[pfn] = PG_FREE | order;
+}
+
+static void area_remove(int order, uint64 pfn) {
+    struct run *r = (struct run*)pfn2pa(pfn);
+    r->prev->next = r->next;
+    r->next->prev = r->prev;
+    kmem.area[order].nr_free--;
+    kmem.pginfo[pfn] = 0;
+}
+
+// 从边界处切出一个自然对齐、尽可能大的块挂入空闲链表，
+// 该块的页描述符此时才清零；边界已到内存顶部时返回 0，调用者持有 kmem.lock
+static int frontier_carve(void) {
+    uint64 pfn = kmem.frontier;
+    if (pfn >= kmem.rsv_start && pfn < kmem.rsv_end) {
+        // 越过保留区，这些页的描述符保持为 0，不会被当作空闲伙伴
+        memset(kmem.pginfo + pfn, 0, kmem.rsv_end - pfn);
+        kmem.frontier = pfn = kmem.rsv_end;
+    }
+    if (pfn >= kmem.npages)
+        return 0;
+
+    int order = MAX_ORDER - 1;
+    while (order > 0 && ((pfn & ((1L << order) - 1)) != 0 || pfn + (1L << order) > kmem.npages ||
+                         (pfn < kmem.rsv_start && pfn + (1L << order) > kmem.rsv_start))) {
+        order--;
+    }
+    memset(kmem.pginfo + pfn, 0, 1L << order);
+    kmem.frontier = pfn + (1L << order);
+    area_push(order, pfn);
+    return 1;
+}
+
+// 分配一个 2^order 页的块，调用者持有 kmem.lock
+static void *buddy_alloc(int order) {
+    int o;
+    for (;;) {
+        o = order;
+        while (o < MAX_ORDER && kmem.area[o].nr_free == 0) {
+            o++;
+        }
+        if (o < MAX_ORDER)
+            break;
+        // 空闲链表中没有足够大的块，从未触及的内存中再切一块
+        if (!frontier_carve())
+            return 0;
+    }
+
+    uint64 pfn = pa2pfn((uint64)kmem.area[o].head.next);
+    area_remove(o, pfn);
+    // 逐级拆分，把高地址的一半挂回低一阶的空闲链表
+    while (o > order) {
+        o--;
+        area_push(o, pfn + (1L << o));
+    }
+    kmem.pginfo[pfn] = order;
+    kmem.nfree -= (1L << order);
+    return pfn2pa(pfn);
+}
+
+// 释放一个 2^order 页的块并与空闲的伙伴逐级合并，调用者持有 kmem.lock
+static void buddy_free(void *pa, int order) {
+    uint64 pfn = pa2pfn((uint64)pa);
+    kmem.nfree += (1L << order);
+    while (order < MAX_ORDER - 1) {
+        uint64 buddy = pfn ^ (1L << order);
+        if (buddy < kmem.base_pfn || buddy + (1L << order) > kmem.frontier)
+            break;
+        if (kmem.pginfo[buddy] != (PG_FREE | order))
+            break;
+        area_remove(order, buddy);
+        if (buddy < pfn)
+            pfn = buddy;
+        order++;
+    }
+    area_push(order, pfn);
+}
+
+// 检查一个块地址是否落在伙伴系统管理的范围内并按阶对齐
+static int valid_block(void *pa, int order) {
+    uint64 a = (uint64)pa;
+    if (order < 0 || order >= MAX_ORDER)
+        return 0;
+    if (a % ((uint64)PGSIZE << order) != 0)
+        return 0;
+    if (a < KERNBASE || pa2pfn(a) < kmem.base_pfn || pa2pfn(a) + (1L << order) > kmem.frontier)
+        return 0;
+    return 1;
+}
 
 // 初始化物理内存分配器
 void kinit() {
-    // 从内核末尾开始，直到物理内存顶部，将所有内存逐页释放
+    spinlock_init(&kmem.lock, "kmem");
+    spinlock_init(&zpool.lock, "zpool");
+    for (int o = 0; o < MAX_ORDER; o++) {
+        kmem.area[o].head.next = &kmem.area[o].head;
+        kmem.area[o].head.prev = &kmem.area[o].head;
+        kmem.area[o].nr_free = 0;
+    }
+
+    // 页描述符数组紧跟在内核镜像之后，其后的内存才交给伙伴系统
     // end 符号由链接脚本提供，表示内核镜像的结束位置
-    // PHYSTOP 是 QEMU virt 机器的物理内存上限 (128MB)
-    freerange(end, (void*)0x88000000); 
+    // 物理内存顶部来自设备树的 /memory 节点
+    uint64 phys_top = machine.mem_top;
+    kmem.npages = (phys_top - KERNBASE) >> PGSHIFT;
+    kmem.pginfo = (uchar*)end;
+    char *start = (char*)PGROUNDUP((uint64)end + kmem.npages);
+    kmem.base_pfn = pa2pfn((uint64)start);
+
+    // 保留设备树所在的页
+    kmem.rsv_start = kmem.rsv_end = kmem.npages;
+    if (machine.dtb_size) {
+        uint64 dtb_end = machine.dtb_base + machine.dtb_size;
+        if (machine.dtb_base < (uint64)start && dtb_end > (uint64)end)
+            panic("kinit: device tree overlaps page descriptors");
+        if (machine.dtb_base >= (uint64)start && dtb_end <= phys_top) {
+            kmem.rsv_start = pa2pfn(PGROUNDDOWN(machine.dtb_base));
+            kmem.rsv_end = pa2pfn(PGROUNDUP(dtb_end));
+        }
+    }
+
+#ifdef KALLOC_EAGER_INIT
+    // 对照模式：启动时清零全部描述符，并将所有内存逐页释放
+    memset(kmem.pginfo, 0, kmem.npages);
+    kmem.frontier = kmem.npages;
+    freerange(start, pfn2pa(kmem.rsv_start));
+    freerange(pfn2pa(kmem.rsv_end), (void*)phys_top);
+#else
+    // 按需初始化：启动时所有页都在边界之上，分配时才切块，
+    // kinit 的开销与物理内存大小无关
+    kmem.frontier = kmem.base_pfn;
+    kmem.nfree = kmem.npages - kmem.base_pfn - (kmem.rsv_end - kmem.rsv_start);
+#endif
     printf("kinit: physical memory allocator initialized.\n");
 }
 
@@ -29,38 +228,348 @@ void freerange(void *pa_start, void *pa_end) {
     }
 }
 
+// 从伙伴系统取一批单页放入本 CPU 缓存，调用者已关中断
+static void kcache_refill(struct kcache *kc) {
+    acquire(&kmem.lock);
+    for (int i = 0; i < KCACHE_BATCH; i++) {
+        struct run *r = buddy_alloc(0);
+        if (r == 0)
+            break;
+        r->next = kc->freelist;
+        kc->freelist = r;
+        kc->count++;
+    }
+    release(&kmem.lock);
+    kc->refills++;
+}
+
+// 把本 CPU 缓存中多余的一批页还给伙伴系统，调用者已关中断
+static void kcache_drain(struct kcache *kc) {
+    struct run *head = kc->freelist;
+    struct run *tail = head;
+    int n = 1;
+
+    // 先在本地摘下一整段链表，然后在一次持锁内全部归还
+    while (n < KCACHE_BATCH && tail->next) {
+        tail = tail->next;
+        n++;
+    }
+    kc->freelist = tail->next;
+    kc->count -= n;
+    tail->next = 0;
+
+    acquire(&kmem.lock);
+    while (head) {
+        struct run *next = head->next;
+        buddy_free(head, 0);
+        head = next;
+    }
+    release(&kmem.lock);
+    kc->drains++;
+}
+
+// 以 64 位字为单位整页填充，每次循环写一条 cache line
+static void page_fill(void *pa, uint64 v) {
+    uint64 *p = (uint64*)pa;
+    uint64 *e = p + PGSIZE / sizeof(uint64);
+    for (; p < e; p += 8) {
+        p[0] = v; p[1] = v; p[2] = v; p[3] = v;
+        p[4] = v; p[5] = v; p[6] = v; p[7] = v;
+    }
+}
+
+static inline void page_zero(void *pa) {
+    page_fill(pa, 0);
+}
+
 // 释放一个物理页
 void kfree(void *pa) {
     struct run *r;
 
     // 检查地址是否合法
-    if (((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= 0x88000000) {
+    if (!valid_block(pa, 0)) {
         printf("kfree: invalid physical address %p\n", pa);
         return;
     }
 
-    // 将页内存清零以防止信息泄露
-    for (int i = 0; i < PGSIZE; i++) {
-        *((char*)pa + i) = 1;
-    }
+#ifdef KALLOC_POISON
+    // 调试构建：用 0x01 填充释放的页，便于发现释放后使用
+    page_fill(pa, 0x0101010101010101UL);
+#endif
 
-    // 将释放的页加入空闲链表头部
+    // 将释放的页加入本 CPU 缓存头部，缓存过多时批量归还
     r = (struct run*)pa;
-    r->next = freelist;
-    freelist = r;
+    push_off();
+    struct kcache *kc = &kcaches[cpuid()];
+    r->next = kc->freelist;
+    kc->freelist = r;
+    kc->count++;
+    if (kc->count > KCACHE_HIGH) {
+        kcache_drain(kc);
+    }
+    pop_off();
 }
 
-// 分配一个物理页
-void *kalloc(void) {
-    struct run *r = freelist;
+// 从预清零页池取一批页放入本 CPU 缓存，调用者已关中断
+// 池空时不拿锁直接返回：池只会因这里取页而降到低水位以下，
+// 那一次已经唤醒了后台线程
+static void kcache_zrefill(struct kcache *kc) {
+    if (__atomic_load_n(&zpool.count, __ATOMIC_RELAXED) == 0)
+        return;
+
+    acquire(&zpool.lock);
+    for (int i = 0; i < ZCACHE_BATCH && zpool.freelist; i++) {
+        struct run *r = zpool.freelist;
+        zpool.freelist = r->next;
+        zpool.count--;
+        r->next = kc->zlist;
+        kc->zlist = r;
+        kc->zcount++;
+    }
+    int low = zpool.count < ZPOOL_LOW;
+    release(&zpool.lock);
+    if (low)
+        wakeup(&zpool);
+}
+
+// 从本 CPU 缓存 (必要时从伙伴系统补充) 取一个未清零的页，不动清零页。
+// 后台清零线程只用这条路径，不会把已清零的页取出来再清零一遍
+static void *kalloc_dirty(void) {
+    struct run *r;
 
+    push_off();
+    struct kcache *kc = &kcaches[cpuid()];
+    if (kc->freelist == 0) {
+        kcache_refill(kc);
+    }
+    r = kc->freelist;
     if (r) {
-        freelist = r->next;
-        // 将分配的页内存清零
-        for (int i = 0; i < PGSIZE; i++) {
-            *((char*)r + i) = 0;
-        }
+        kc->freelist = r->next;
+        kc->count--;
     }
-    
+    pop_off();
+
     return (void*)r;
-}
\ No newline at end of file
+}
+
+// 分配一个物理页 (伙伴系统 0 阶的快速路径)，内容未定义
+// 适用于马上会被整页覆盖的场合。伙伴系统已空时改用已清零的页
+void *kalloc_nozero(void) {
+    struct run *r = kalloc_dirty();
+    if (r)
+        return (void*)r;
+
+    push_off();
+    struct kcache *kc = &kcaches[cpuid()];
+    if (kc->zlist == 0) {
+        kcache_zrefill(kc);
+    }
+    r = kc->zlist;
+    if (r) {
+        kc->zlist = r->next;
+        kc->zcount--;
+    }
+    pop_off();
+
+    return (void*)r;
+}
+
+// 把预清零页池中的页全部还给伙伴系统，让它们有机会合并成多页块。
+// 只在伙伴系统满足不了多页分配时调用，返回归还的页数
+static int zpool_reclaim(void) {
+    acquire(&zpool.lock);
+    struct run *r = zpool.freelist;
+    int n = zpool.count;
+    zpool.freelist = 0;
+    zpool.count = 0;
+    release(&zpool.lock);
+    if (r == 0)
+        return 0;
+
+    acquire(&kmem.lock);
+    while (r) {
+        struct run *next = r->next;
+        buddy_free(r, 0);
+        r = next;
+    }
+    release(&kmem.lock);
+    return n;
+}
+
+// 分配一个内容全为零的物理页：先用本 CPU 缓存的清零页，
+// 用完时才从预清零页池成批补充，池也空了就现场清零
+void *kalloc_zeroed(void) {
+    struct run *r;
+
+    push_off();
+    struct kcache *kc = &kcaches[cpuid()];
+    if (kc->zlist == 0) {
+        kcache_zrefill(kc);
+    }
+    r = kc->zlist;
+    if (r) {
+        kc->zlist = r->next;
+        kc->zcount--;
+        kc->zhits++;
+    } else {
+        kc->zmisses++;
+    }
+    pop_off();
+
+    if (r) {
+        r->next = 0;      // 链表指针是页内唯一的非零字
+        return (void*)r;
+    }
+
+    r = kalloc_dirty();
+    if (r)
+        page_zero(r);
+    return (void*)r;
+}
+
+// 分配一个清零的物理页
+void *kalloc(void) {
+    return kalloc_zeroed();
+}
+
+// 后台清零线程：池低于低水位时由 kcache_zrefill() 唤醒，补充到目标值
+// 清零在池锁之外进行，kalloc_zeroed() 的调用者不会被它阻塞。
+// 内存耗尽时隔一个节拍再试，不与分配者抢 kmem.lock 空转
+void kzero_task(void) {
+    for (;;) {
+        acquire(&zpool.lock);
+        while (zpool.count >= ZPOOL_LOW) {
+            sleep(&zpool, &zpool.lock);
+        }
+        int want = ZPOOL_TARGET - zpool.count;
+        release(&zpool.lock);
+
+        for (int i = 0; i < want; i++) {
+            struct run *r = kalloc_dirty();
+            if (r == 0) {
+                sleep_ticks(1);
+                break;
+            }
+            page_zero(r);
+            acquire(&zpool.lock);
+            r->next = zpool.freelist;
+            zpool.freelist = r;
+            zpool.count++;
+            zpool.zeroed++;
+            release(&zpool.lock);
+        }
+    }
+}
+
+// 分配 2^order 个物理上连续的页，内容未定义
+// 适用于马上会被整块覆盖的场合，例如 fork 复制内核栈
+void *kalloc_pages_nozero(int order) {
+    if (order == 0)
+        return kalloc_nozero();
+    if (order < 0 || order >= MAX_ORDER)
+        return 0;
+
+    acquire(&kmem.lock);
+    void *pa = buddy_alloc(order);
+    release(&kmem.lock);
+    if (pa == 0 && zpool_reclaim() > 0) {
+        acquire(&kmem.lock);
+        pa = buddy_alloc(order);
+        release(&kmem.lock);
+    }
+    return pa;
+}
+
+// 分配 2^order 个物理上连续并已清零的页，首地址按块大小对齐
+void *kalloc_pages(int order) {
+    if (order == 0)
+        return kalloc();
+
+    void *pa = kalloc_pages_nozero(order);
+    if (pa) {
+        for (int i = 0; i < (1 << order); i++) {
+            page_zero((char*)pa + i * PGSIZE);
+        }
+    }
+    return pa;
+}
+
+// 释放 kalloc_pages(order) 分配的块
+void kfree_pages(void *pa, int order) {
+    if (order == 0) {
+        kfree(pa);
+        return;
+    }
+    if (!valid_block(pa, order)) {
+        printf("kfree_pages: invalid block %p order %d\n", pa, order);
+        return;
+    }
+#ifdef KALLOC_POISON
+    for (int i = 0; i < (1 << order); i++) {
+        page_fill((char*)pa + i * PGSIZE, 0x0101010101010101UL);
+    }
+#endif
+
+    acquire(&kmem.lock);
+    buddy_free(pa, order);
+    release(&kmem.lock);
+}
+
+// 统计当前空闲页数 (伙伴系统 + 各 CPU 缓存 + 预清零页池)，用于测试检查泄漏
+uint64 kfreemem(void) {
+    uint64 n;
+
+    acquire(&kmem.lock);
+    n = kmem.nfree;
+    release(&kmem.lock);
+    acquire(&zpool.lock);
+    n += zpool.count;
+    release(&zpool.lock);
+    for (int i = 0; i < NCPU; i++) {
+        n += kcaches[i].count + kcaches[i].zcount;
+    }
+    return n;
+}
+
+// 返回预清零页池中的页数 (不含已分到各 CPU 缓存的清零页)
+int kalloc_zpool_count(void) {
+    return zpool.count;
+}
+
+// 返回某一阶的空闲块数
+uint64 kalloc_free_blocks(int order) {
+    if (order < 0 || order >= MAX_ORDER)
+        return 0;
+    return kmem.area[order].nr_free;
+}
+
+// 打印每 CPU 缓存的批量交换次数
+void kalloc_dump_stats(void) {
+    printf("kalloc: buddy free=%lu pages\n", kmem.nfree);
+    for (int i = 0; i < NCPU; i++) {
+        struct kcache *kc = &kcaches[i];
+        printf("  cpu%d: cached=%d refills=%lu drains=%lu zcached=%d zhits=%lu zmisses=%lu\n",
+               i, kc->count, kc->refills, kc->drains, kc->zcount, kc->zhits, kc->zmisses);
+    }
+    printf("  zpool: cached=%d zeroed=%lu\n", zpool.count, zpool.zeroed);
+}
+
+// 打印伙伴系统各阶的空闲块和碎片化程度
+// unusable 表示对该阶的分配而言，空闲页中落在更小块里、无法使用的比例
+void kalloc_dump_buddy(void) {
+    acquire(&kmem.lock);
+    uint64 total = kmem.nfree;
+    uint64 untouched = kmem.npages - kmem.frontier;
+    printf("buddy: %lu free pages (%lu never touched)\n", total, untouched);
+    for (int o = 0; o < MAX_ORDER; o++) {
+        // 边界之上的页总能切出最大阶的块
+        uint64 usable = untouched;
+        for (int j = o; j < MAX_ORDER; j++) {
+            usable += kmem.area[j].nr_free << j;
+        }
+        uint64 unusable = total ? (total - usable) * 100 / total : 0;
+        printf("  order %d (%d KB): free blocks=%lu unusable=%lu%%\n",
+               o, (PGSIZE << o) / 1024, kmem.area[o].nr_free, unusable);
+    }
+    release(&kmem.lock);
+}
@@ -16,7 +16,8 @@ struct klog_record {
 // 全局日志状态结构体：管理整个日志系统
 struct klog_state {
     struct spinlock lock;           // 自旋锁，用于多核并发保护
-    struct klog_record buffer[KLOG_BUFFER_SIZE]; // 环形缓冲区数组
+    struct klog_record *buffer[KLOG_BUFFER_SIZE]; // 环形缓冲区，槽位首次写入时才从 slab 分配记录
+    struct kmem_cache *cache;       // 日志记录的 slab 缓存
     int next;                       // 下一个写入位置的索引
     int count;                      // 当前缓冲区中的有效日志数量
     enum klog_level buffer_level;   // 缓冲区记录等级阈值 (低于此等级不存入内存)
@@ -194,7 +195,8 @@ void klog_init(void) {
     if (klog.initialized) {
         return;
     }
-    spinlock_init(&klog.lock, "klog");
+    spinlock_init_type(&klog.lock, "klog", SPIN_TICKET);
+    klog.cache = kmem_cache_create("klog_record", sizeof(struct klog_record), 0, 0);
     klog.next = 0;
     klog.count = 0;
     // 默认配置：详细记录到内存，仅警告/错误输出到屏幕
@@ -245,7 +247,11 @@ void klog_write(enum klog_level level, const char *component, const char *fmt, .
     klog.total_generated++;
 
     // 检查是否需要写入内存缓冲区
-    if (rec.level >= klog.buffer_level) {
+    // 槽位第一次使用时分配记录，之后回绕覆盖时直接复用
+    if (rec.level >= klog.buffer_level && klog.buffer[klog.next] == 0) {
+        klog.buffer[klog.next] = kmem_cache_alloc(klog.cache);
+    }
+    if (rec.level >= klog.buffer_level && klog.buffer[klog.next] != 0) {
         // 如果缓冲区满了，增加覆盖计数
         if (klog.count == KLOG_BUFFER_SIZE) {
             klog.overwritten++;
@@ -253,7 +259,7 @@ void klog_write(enum klog_level level, const char *component, const char *fmt, .
             klog.count++;
         }
         // 写入环形缓冲区 (覆盖旧数据)
-        klog.buffer[klog.next] = rec;
+        *klog.buffer[klog.next] = rec;
         // 更新写入指针 (循环回绕)
         klog.next = (klog.next + 1) % KLOG_BUFFER_SIZE;
         klog.stored++;
@@ -313,7 +319,7 @@ void klog_dump_recent(int max_entries) {
     int start = (klog.next - available + KLOG_BUFFER_SIZE) % KLOG_BUFFER_SIZE;
     for (int i = 0; i < available; i++) {
         int idx = (start + i) % KLOG_BUFFER_SIZE;
-        struct klog_record rec = klog.buffer[idx];
+        struct klog_record rec = *klog.buffer[idx];
         release(&klog.lock);
         print_record(&rec);
         acquire(&klog.lock);
@@ -383,7 +389,7 @@ int klog_read(uint64 user_buf, int n) {
 
         // 1. 定位最旧的一条日志 (Tail)
         int idx = (klog.next - klog.count + KLOG_BUFFER_SIZE) % KLOG_BUFFER_SIZE;
-        struct klog_record *rec = &klog.buffer[idx];
+        struct klog_record *rec = klog.buffer[idx];
 
         // 2. 将结构化日志格式化为文本（暂存到内核栈中）
         // 格式: [LEVEL][time=...][comp] msg...
@@ -0,0 +1,217 @@
+// kernel/lockstat.c
+// 锁竞争统计 (make LOCKSTAT=1)。同名的锁归为一类，分别记录获取次数、
+// 遇到竞争的次数、等锁的时间 (总计与最大)、持有时间，以及竞争最多的调用点。
+// 自旋锁以 rdcycle 计时；睡眠锁可能在另一个 hart 上被释放，以 time CSR 计时。
+// 统计本身不拿锁，计数用原子操作，同一个调用点在多个 CPU 上首次出现时
+// 可能占用两个槽位，不影响总数。
+//
+// 调用点表满了以后按 space-saving 的做法替换：不在表中的调用点遇到竞争时
+// 顶替竞争次数最少的槽位，并继承它的竞争次数。这样竞争最多的调用点总会
+// 留在表中，不会被最早出现的几个调用点占住；代价是新调用点的竞争次数
+// 最多高估它继承的那部分 (err)。
+//
+// 不定义 LOCKSTAT 时本文件为空，spinlock.c/sleeplock.c 中的统计代码也不参与编译。
+#include "defs.h"
+
+#ifdef LOCKSTAT
+
+#define LOCKSTAT_CLASSES 64
+#define LOCKSTAT_SITES   8
+#define LOCKSTAT_NAMELEN 16
+
+struct lockstat_site {
+    uint64 pc;                  // 调用 acquire/acquiresleep 处的返回地址
+    uint64 count;
+    uint64 contended;
+    uint64 err;                 // 顶替进来时继承的竞争次数
+};
+
+struct lockstat {
+    char *name;
+    int sleep;                  // 睡眠锁，时间单位为 time CSR
+    int site_lock;              // 替换调用点槽位用的裸标志，lockstat_reset 不清除
+    uint64 nr_acquire;
+    uint64 nr_contended;
+    uint64 wait;                // 等锁的时间
+    uint64 wait_max;
+    uint64 hold;                // 持有的时间
+    uint64 hold_max;
+    uint64 nr_other_sites;      // 不在调用点表中的获取次数，含被替换掉的调用点
+    struct lockstat_site site[LOCKSTAT_SITES];
+};
+
+static struct lockstat classes[LOCKSTAT_CLASSES];
+static int nr_classes;
+static int nr_overflow;         // 类别表已满，未统计的锁
+static int reg_lock;            // 登记新类别用的裸标志，不能用 spinlock
+
+static void stat_add(uint64 *p, uint64 v) {
+    __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+}
+
+static void stat_max(uint64 *p, uint64 v) {
+    uint64 old = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (v > old &&
+           !__atomic_compare_exchange_n(p, &old, v, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+// 查找或登记名为 name 的锁类别，表满时返回 0 (不统计)
+struct lockstat *lockstat_class(char *name, int sleep) {
+    struct lockstat *ls = 0;
+    while (__atomic_test_and_set(&reg_lock, __ATOMIC_ACQUIRE))
+        ;
+    for (int i = 0; i < nr_classes; i++) {
+        if (classes[i].sleep == sleep && strncmp(classes[i].name, name, LOCKSTAT_NAMELEN) == 0) {
+            ls = &classes[i];
+            break;
+        }
+    }
+    if (ls == 0) {
+        if (nr_classes < LOCKSTAT_CLASSES) {
+            ls = &classes[nr_classes++];
+            ls->name = name;
+            ls->sleep = sleep;
+        } else {
+            nr_overflow++;
+        }
+    }
+    __atomic_clear(&reg_lock, __ATOMIC_RELEASE);
+    return ls;
+}
+
+// 在调用点表中记一次获取：pc 已在表中或还有空槽位时返回 1
+static int site_record(struct lockstat *ls, uint64 pc, int contended) {
+    for (int i = 0; i < LOCKSTAT_SITES; i++) {
+        struct lockstat_site *s = &ls->site[i];
+        uint64 cur = __atomic_load_n(&s->pc, __ATOMIC_RELAXED);
+        if (cur == 0) {
+            uint64 zero = 0;
+            if (!__atomic_compare_exchange_n(&s->pc, &zero, pc, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+                && zero != pc)
+                continue;
+            cur = pc;
+        }
+        if (cur == pc) {
+            stat_add(&s->count, 1);
+            if (contended)
+                stat_add(&s->contended, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 表已满，让遇到竞争的 pc 顶替竞争次数最少的槽位。另一个 CPU 正在替换时
+// 放弃，这次获取记入 nr_other_sites。替换期间其他 CPU 的无锁计数可能
+// 记到新调用点上，误差不超过并发的几次获取
+static int site_replace(struct lockstat *ls, uint64 pc) {
+    if (__atomic_test_and_set(&ls->site_lock, __ATOMIC_ACQUIRE))
+        return 0;
+    struct lockstat_site *victim = &ls->site[0];
+    for (int i = 1; i < LOCKSTAT_SITES; i++) {
+        if (ls->site[i].contended < victim->contended)
+            victim = &ls->site[i];
+    }
+    uint64 base = victim->contended;
+    stat_add(&ls->nr_other_sites, victim->count);
+    __atomic_store_n(&victim->pc, pc, __ATOMIC_RELAXED);
+    __atomic_store_n(&victim->count, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&victim->contended, base + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&victim->err, base, __ATOMIC_RELAXED);
+    __atomic_clear(&ls->site_lock, __ATOMIC_RELEASE);
+    return 1;
+}
+
+void lockstat_acquired(struct lockstat *ls, uint64 pc, int contended, uint64 wait) {
+    if (ls == 0)
+        return;
+    stat_add(&ls->nr_acquire, 1);
+    if (contended) {
+        stat_add(&ls->nr_contended, 1);
+        stat_add(&ls->wait, wait);
+        stat_max(&ls->wait_max, wait);
+    }
+
+    if (site_record(ls, pc, contended))
+        return;
+    if (contended && site_replace(ls, pc))
+        return;
+    stat_add(&ls->nr_other_sites, 1);
+}
+
+void lockstat_released(struct lockstat *ls, uint64 hold) {
+    if (ls == 0)
+        return;
+    stat_add(&ls->hold, hold);
+    stat_max(&ls->hold_max, hold);
+}
+
+static uint64 ls_time_ns(uint64 t) {
+    return t * 1000000000UL / machine.timebase;
+}
+
+// 按竞争次数从多到少输出，只列出被获取过的类别
+void lockstat_dump(void) {
+    int order[LOCKSTAT_CLASSES];
+    int n = 0;
+    for (int i = 0; i < nr_classes; i++) {
+        if (classes[i].nr_acquire == 0)
+            continue;
+        int j = n++;
+        while (j > 0 && classes[order[j - 1]].nr_contended < classes[i].nr_contended) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    printf("=== Lock Statistics (spin: cycles, sleep: ns) ===\n");
+    for (int k = 0; k < n; k++) {
+        struct lockstat *ls = &classes[order[k]];
+        uint64 wait = ls->wait, wait_max = ls->wait_max;
+        uint64 hold = ls->hold / ls->nr_acquire, hold_max = ls->hold_max;
+        if (ls->sleep) {
+            wait = ls_time_ns(wait);
+            wait_max = ls_time_ns(wait_max);
+            hold = ls_time_ns(hold);
+            hold_max = ls_time_ns(hold_max);
+        }
+        printf("  %s%s: acquire=%lu contended=%lu wait=%lu wait_max=%lu hold_avg=%lu hold_max=%lu\n",
+               ls->name, ls->sleep ? " (sleep)" : "", ls->nr_acquire, ls->nr_contended,
+               wait, wait_max, hold, hold_max);
+        // 调用点按竞争次数从多到少输出
+        int sorder[LOCKSTAT_SITES];
+        int ns = 0;
+        for (int i = 0; i < LOCKSTAT_SITES && ls->site[i].pc; i++) {
+            int j = ns++;
+            while (j > 0 && ls->site[sorder[j - 1]].contended < ls->site[i].contended) {
+                sorder[j] = sorder[j - 1];
+                j--;
+            }
+            sorder[j] = i;
+        }
+        for (int i = 0; i < ns; i++) {
+            struct lockstat_site *s = &ls->site[sorder[i]];
+            if (s->err)
+                printf("      %p: acquire=%lu contended=%lu (err<=%lu)\n",
+                       s->pc, s->count, s->contended, s->err);
+            else
+                printf("      %p: acquire=%lu contended=%lu\n", s->pc, s->count, s->contended);
+        }
+        if (ls->nr_other_sites)
+            printf("      other sites: acquire=%lu\n", ls->nr_other_sites);
+    }
+    if (nr_overflow)
+        printf("  %d locks not tracked (class table full)\n", nr_overflow);
+}
+
+// 清零计数，保留已登记的类别 (锁中保存着类别指针)
+void lockstat_reset(void) {
+    for (int i = 0; i < nr_classes; i++) {
+        struct lockstat *ls = &classes[i];
+        memset(&ls->nr_acquire, 0, sizeof(*ls) - ((char*)&ls->nr_acquire - (char*)ls));
+    }
+}
+
+#endif // LOCKSTAT
@@ -8,25 +8,114 @@ void main_task(void) {
     run_lab6_tests();
     run_lab7_tests();
     run_lab8_tests();
+    run_perf_tests();
+    run_sched_bench();
     printf("\n===== All Labs Complete =====\n");
     printf("Press Ctrl-A then X to quit QEMU.\n");
-    KLOG_INFO("main", "all labs finished; entering idle loop");
-    while (1);
+    KLOG_INFO("main", "all labs finished; main_task exiting");
+    // 退出后所有 CPU 都进入 scheduler() 的 wfi 空闲路径
+    exit(0);
 }
 
-void kmain(void) {
+extern char _start_secondary[];
+
+// SBI HSM 扩展：启动一个处于停止状态的 hart，
+// 它将以 S 模式从 start_addr 开始执行，a0 = hartid，a1 = opaque
+static inline long sbi_hart_start(uint64 hartid, uint64 start_addr, uint64 opaque) {
+    register uint64 a7 asm("a7") = 0x48534D;   // "HSM"
+    register uint64 a6 asm("a6") = 0;          // hart_start
+    register uint64 a0 asm("a0") = hartid;
+    register uint64 a1 asm("a1") = start_addr;
+    register uint64 a2 asm("a2") = opaque;
+    asm volatile("ecall" : "+r"(a0), "+r"(a1) : "r"(a2), "r"(a6), "r"(a7) : "memory");
+    return (long)a0;
+}
+
+// 其他 hart 的 C 入口：只做本 hart 相关的初始化，然后进入各自的调度循环
+void secondary_main(uint64 hartid, uint64 cpu) {
+    mycpu()->hartid = hartid;
+    kvminithart();
+    trap_init();
+    clock_init();
+    printf("hart %lu started as cpu %lu\n", hartid, cpu);
+    scheduler();
+}
+
+// 全局初始化完成后再启动其他 hart，它们不会看到未初始化的数据结构
+static void start_secondary_harts(void) {
+    __sync_synchronize();
+    for (int i = 1; i < machine.ncpu; i++) {
+        long err = sbi_hart_start(machine.hartid[i], (uint64)_start_secondary, i);
+        if (err != 0) {
+            printf("kmain: failed to start hart %lu (sbi error %ld)\n", machine.hartid[i], err);
+        }
+    }
+}
+
+// 启动阶段计时：记录 fdt_init 到 iinit 每一步花费的 time CSR 计数
+#define NBOOT_PHASE 16
+
+static struct {
+    const char *name;
+    uint64 ticks;
+} boot_phases[NBOOT_PHASE];
+static int nboot_phases;
+static uint64 boot_last;
+
+static void boot_phase_done(const char *name) {
+    uint64 now = get_time();
+    if (nboot_phases < NBOOT_PHASE) {
+        boot_phases[nboot_phases].name = name;
+        boot_phases[nboot_phases].ticks = now - boot_last;
+        nboot_phases++;
+    }
+    boot_last = now;
+}
+
+static void boot_report(void) {
+    uint64 total = 0;
+    printf("=== Boot Phase Timing ===\n");
+    for (int i = 0; i < nboot_phases; i++) {
+        printf("  %s: %lu ticks (%lu us)\n", boot_phases[i].name, boot_phases[i].ticks,
+               boot_phases[i].ticks * 1000000 / machine.timebase);
+        total += boot_phases[i].ticks;
+    }
+    printf("  total: %lu ticks (%lu us)\n", total, total * 1000000 / machine.timebase);
+}
+
+void kmain(uint64 hartid, uint64 dtb) {
+    printfinit();
     clear_screen();
     printf("===== Kernel Booting =====\n");
+    mycpu()->hartid = hartid;
+    boot_last = get_time();
+    fdt_init(hartid, dtb);
+    boot_phase_done("fdt_init");
     kinit();
+    boot_phase_done("kinit");
+    slab_init();
+    boot_phase_done("slab_init");
     kvminit();
+    boot_phase_done("kvminit");
     kvminithart();
+    boot_phase_done("kvminithart");
     procinit();
+    boot_phase_done("procinit");
     trap_init();
+    boot_phase_done("trap_init");
     clock_init();
+    boot_phase_done("clock_init");
+    timer_init();
+    boot_phase_done("timer_init");
     binit();
+    boot_phase_done("binit");
     fileinit();
+    boot_phase_done("fileinit");
     virtio_disk_init();
+    boot_phase_done("virtio_disk_init");
     iinit();
+    boot_phase_done("iinit");
+    boot_report();
     initlog(ROOTDEV, &sb);
     klog_init();
     KLOG_INFO("boot", "subsystems initialized, starting user workload");
@@ -36,5 +125,11 @@ void kmain(void) {
         KLOG_FATAL("boot", "failed to spawn main_task");
         while(1);
     }
+    // 后台清零线程，为 kalloc_zeroed() 补充预清零页
+    if (create_process(kzero_task) < 0) {
+        printf("kmain: failed to create kzero_task\n");
+        while(1);
+    }
+    start_secondary_harts();
     scheduler();
 }
\ No newline at end of file
@@ -1,11 +1,9 @@
 #ifndef __PARAM_H__
 #define __PARAM_H__
 
-#define NPROC        64
-#define NCPU         1
+#define NCPU         8          // 支持的最大 hart 数，实际数目来自设备树
 #define NOFILE       16
-#define NFILE        100
-#define NINODE       300
+#define NINODE       300        // 磁盘上的 inode 数 (格式化时使用)
 #define NDEV         10
 #define ROOTDEV      1
 #define MAXOPBLOCKS  10
@@ -14,5 +12,17 @@
 #define MAXPATH      128
 #define BSIZE        1024
 #define FSSIZE       4096
+#define MAX_ORDER    11         // 伙伴系统最大块为 2^(MAX_ORDER-1) 页 (4MB)
+#define KSTACK_ORDER 2          // 内核栈为 2^KSTACK_ORDER 个连续页
+#define KSTACKSIZE   (4096 << KSTACK_ORDER)
+#define TIMEBASE_HZ  10000000   // 设备树缺失时默认的 time CSR 频率 (10MHz)
+#define TICK_HZ      100        // 时钟中断频率
+#define NOHZ_IDLE_MAX 100       // 动态节拍下空闲 CPU 两次时钟中断的最大间隔 (节拍)
+#define SCHED_QUANTUM 1         // 默认时间片长度 (时钟节拍数)
+#define MLFQ_LEVELS  4          // 多级反馈队列的优先级数，0 最高
+#define MLFQ_BOOST_TICKS 100    // 每隔多少节拍把所有进程提回基础优先级
+#define NICE_MIN     (-20)
+#define NICE_MAX     19
+#define NGROUP       8          // CFS 调度组数，组 0 为默认组
 
 #endif // __PARAM_H__
@@ -3,6 +3,17 @@
 #include "defs.h"
 #include "riscv.h" // 引入 riscv.h 以使用 uint64 类型
 
+// 多个 hart 同时打印时用锁保证一行不被打断；panic 时不再加锁
+static struct {
+    struct spinlock lock;
+    int locking;
+} pr;
+
+void printfinit(void) {
+    spinlock_init(&pr.lock, "pr");
+    pr.locking = 1;
+}
+
 // 静态辅助函数，用于打印不同进制的数字。
 static void print_int(long long xx, int base, int sign) {
     char digits[] = "0123456789abcdef";
@@ -46,11 +57,16 @@ void printf(const char *fmt, ...) {
     va_list args;
     char *s;
     int c;
+    int locking;
 
     if (fmt == 0) {
         return;
     }
 
+    locking = pr.locking;
+    if (locking)
+        acquire(&pr.lock);
+
     va_start(args, fmt);
     for (c = *fmt; c != '\0'; c = *++fmt) {
         if (c != '%') {
@@ -107,6 +123,9 @@ void printf(const char *fmt, ...) {
         }
     }
     va_end(args);
+
+    if (locking)
+        release(&pr.lock);
 }
 
 // 清屏函数
@@ -118,6 +137,7 @@ void clear_screen() {
 }
 
 void panic(const char *msg) {
+    pr.locking = 0;
     printf("\npanic: %s\n", msg);
     while (1) { }
 }
\ No newline at end of file
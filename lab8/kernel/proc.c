@@ -1,15 +1,37 @@
 // kernel/proc.c
 #include "defs.h"
 
-struct proc proc[NPROC];
-struct cpu cpus[1]; 
+struct cpu cpus[NCPU];
 struct proc *initproc;
 static int nextpid = 1;
+static struct spinlock pid_lock;
+
+// 进程表：proc 对象来自 slab 缓存，所有已分配的进程串成双向链表，
+// 供 wait() 等按 pid/父进程查找时遍历；调度只使用 sched.c 中的每 CPU
+// 运行队列，唤醒只使用下面按 chan 散列的等待队列。
+// 持有 ptable.lock 时不获取任何 p->lock，而持有自身锁的
+// 运行中进程 (如 exit、wait 中) 可以安全地再获取 ptable.lock。
+struct ptable ptable;
+
+// 父子进程之间的退出通知：子进程在 exit() 中持有它设置 ZOMBIE 并唤醒父进程，
+// wait() 持有它扫描子进程并以它为条件锁睡眠，唤醒不会落在扫描与入睡之间。
+// 加锁顺序：wait_lock 在 p->lock 与 ptable.lock 之前
+static struct spinlock wait_lock;
+
+static struct kmem_cache *proc_cache;
+static struct kmem_cache *trapframe_cache;
 
 extern void fork_ret(void);
 
+// 当前 hart 的 cpu 结构，tp 中保存着 CPU 编号；
+// 开中断时进程可能随时被迁移，结果只在关中断期间有意义
 struct cpu* mycpu(void) {
-    return &cpus[0];
+    return &cpus[r_tp()];
+}
+
+// 当前 CPU 编号，调用者必须已关中断
+int cpuid(void) {
+    return mycpu() - cpus;
 }
 
 struct proc* myproc(void) {
@@ -20,10 +42,59 @@ struct proc* myproc(void) {
     return p;
 }
 
+static void proc_ctor(void *obj) {
+    struct proc *p = (struct proc*)obj;
+    memset(p, 0, sizeof(*p));
+    spinlock_init(&p->lock, "proc");
+    p->state = UNUSED;
+    p->group = -1;
+}
+
+// 挂到进程表尾部，调用者持有 ptable.lock
+static void ptable_append(struct proc *p) {
+    p->all_next = 0;
+    p->all_prev = ptable.tail;
+    if (ptable.tail)
+        ptable.tail->all_next = p;
+    else
+        ptable.head = p;
+    ptable.tail = p;
+    ptable.count++;
+}
+
+static void ptable_insert(struct proc *p) {
+    acquire(&ptable.lock);
+    ptable_append(p);
+    release(&ptable.lock);
+}
+
+// 从进程表摘除，调用者持有 ptable.lock
+static void ptable_unlink(struct proc *p) {
+    if (p->all_prev)
+        p->all_prev->all_next = p->all_next;
+    else
+        ptable.head = p->all_next;
+    if (p->all_next)
+        p->all_next->all_prev = p->all_prev;
+    else
+        ptable.tail = p->all_prev;
+    p->all_next = p->all_prev = 0;
+    ptable.count--;
+}
+
+// 释放进程占用的资源，并把 proc 对象还给 slab 缓存。
+// 调用者不能持有 p->lock 和 ptable.lock
 static void freeproc(struct proc *p) {
-    if (p->trapframe) kfree((void*)p->trapframe);
+    if (p->state != USED) {
+        acquire(&ptable.lock);
+        ptable_unlink(p);
+        release(&ptable.lock);
+    }
+    sched_group_leave(p);
+    sched_dl_leave(p);
+    if (p->trapframe) kmem_cache_free(trapframe_cache, p->trapframe);
     p->trapframe = 0;
-    if (p->kstack) kfree((void*)p->kstack);
+    if (p->kstack) kfree_pages((void*)p->kstack, KSTACK_ORDER);
     p->kstack = 0;
     p->pagetable = 0;
     p->pid = 0;
@@ -43,64 +114,125 @@ static void freeproc(struct proc *p) {
         p->cwd = 0;
     }
     p->state = UNUSED;
+    kmem_cache_free(proc_cache, p);
 }
 
 void proc_entry(void) {
     struct proc *p = myproc();
+    // 可能是 sched() 在中断处理中直接切换过来的，新进程总是开中断运行
+    mycpu()->intena = 1;
+    switch_finish();
     release(&p->lock);
     if (p->entry) p->entry();
     exit(0);
 }
 
+// 分配一个新进程；返回时进程处于 USED 状态且尚未加入进程表，
+// 调用者设置好内容后用 ptable_insert() 发布
 static struct proc* allocproc(void) {
-    struct proc *p;
-    for(p = proc; p < &proc[NPROC]; p++) {
-        acquire(&p->lock);
-        if(p->state == UNUSED) {
-            goto found;
-        } else {
-            release(&p->lock);
-        }
-    }
-    return 0;
+    struct proc *p = kmem_cache_alloc(proc_cache);
+    if (p == 0)
+        return 0;
 
-found:
+    acquire(&pid_lock);
     p->pid = nextpid++;
+    release(&pid_lock);
     p->state = USED;
 
-    if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    if((p->trapframe = kmem_cache_alloc(trapframe_cache)) == 0){
         freeproc(p);
-        release(&p->lock);
         return 0;
     }
     
     // 初始化 trapframe
-    char *tf = (char*)p->trapframe;
-    for(int i=0; i<4096; i++) tf[i] = 0;
+    memset(p->trapframe, 0, sizeof(struct trapframe));
 
-    // 分配内核栈
-    if((p->kstack = (uint64)kalloc()) == 0){
+    // 分配内核栈 (多个物理连续页)，不必清零：
+    // fork 会整体复制父进程的栈，其余情况从栈顶向下使用
+    if((p->kstack = (uint64)kalloc_pages_nozero(KSTACK_ORDER)) == 0){
         freeproc(p);
-        release(&p->lock);
         return 0;
     }
 
-    p->context.sp = p->kstack + PGSIZE;
+    p->context.sp = p->kstack + KSTACKSIZE;
     p->context.ra = (uint64)proc_entry;
     for (int i = 0; i < NOFILE; i++) {
         p->ofile[i] = 0;
     }
     p->cwd = 0;
-
-    release(&p->lock);
+    p->parent = 0;
+    p->chan = 0;
+    p->killed = 0;
+    p->xstate = 0;
+    p->entry = 0;
+    p->name[0] = 0;
+    p->rq_next = 0;
+    p->rq_cpu = -1;
+    p->cpu = -1;
+    p->held_locks = 0;
+    p->blocked_on = 0;
+    p->nice = 0;
+    p->nice_base = 0;
+    p->prio = 0;
+    p->slice_used = 0;
+    p->boost_epoch = 0;
+    p->allowed_cpu = -1;
+    p->dl_runtime = 0;
+    p->dl_util = 0;
+    p->dl_active = 0;
+    p->dl_jobs = 0;
+    p->dl_misses = 0;
+    p->group = -1;
+    p->vruntime = 0;
+    p->exec_start = 0;
+    p->sum_exec_runtime = 0;
+    p->run_delay = 0;
+    p->nr_runs = 0;
+    p->sleep_timer.pending = 0;
+    p->nr_wakeups = 0;
+    p->nr_voluntary_switches = 0;
+    p->nr_involuntary_switches = 0;
     return p;
 }
 
-void procinit(void) {
-    for (int i = 0; i < NPROC; i++) {
-        spinlock_init(&proc[i].lock, "proc");
-        proc[i].state = UNUSED;
+// 等待队列按 chan 地址散列：sleep() 把进程挂到 chan 所在的桶里，
+// wakeup() 只访问这个桶，与系统中的进程总数无关。
+// 锁顺序为 (调用者的条件锁) -> p->lock -> 桶锁；唤醒者在桶锁下摘下等待者，
+// 放开桶锁后再逐个获取 p->lock
+#define NWAITQ 64
+
+struct waitq {
+    struct spinlock lock;
+    struct proc *head;
+    struct proc *tail;
+};
+
+static struct waitq waitqs[NWAITQ];
+
+static struct waitq *waitq_of(void *chan) {
+    uint64 h = (uint64)chan;
+    h ^= h >> 6;
+    h ^= h >> 12;
+    return &waitqs[(h >> 3) % NWAITQ];
+}
+
+static void waitq_init(void) {
+    for (int i = 0; i < NWAITQ; i++) {
+        spinlock_init(&waitqs[i].lock, "waitq");
+        waitqs[i].head = waitqs[i].tail = 0;
     }
+}
+
+void procinit(void) {
+    spinlock_init(&pid_lock, "nextpid");
+    spinlock_init(&ptable.lock, "ptable");
+    spinlock_init(&wait_lock, "wait_lock");
+    ptable.head = ptable.tail = 0;
+    ptable.count = 0;
+    runq_init();
+    waitq_init();
+    proc_cache = kmem_cache_create("proc", sizeof(struct proc), 0, proc_ctor);
+    trapframe_cache = kmem_cache_create("trapframe", sizeof(struct trapframe), 16, 0);
     printf("procinit: complete\n");
 }
 
@@ -112,8 +244,11 @@ int create_process(void (*entry)(void)) {
     if (p->cwd == 0) {
         p->cwd = iget(ROOTDEV, ROOTINO);
     }
+    sched_group_join(p, 0);
+    ptable_insert(p);
     acquire(&p->lock);
     p->state = RUNNABLE;
+    runq_add(p);
     release(&p->lock);
     KLOG_INFO("proc", "created process pid=%d entry=%p", p->pid, entry);
     return p->pid;
@@ -130,7 +265,7 @@ int fork(void) {
     *(np->trapframe) = *(p->trapframe);
 
     // 2. 复制内核栈并重定位 SP
-    memmove((void*)np->kstack, (void*)p->kstack, PGSIZE);
+    memmove((void*)np->kstack, (void*)p->kstack, KSTACKSIZE);
 
     uint64 sp_offset = p->trapframe->sp - p->kstack;
     np->trapframe->sp = np->kstack + sp_offset;
@@ -154,53 +289,244 @@ int fork(void) {
         np->cwd = idup(p->cwd);
     }
     np->parent = p;
+    // 继承来的优先级不传给子进程
+    np->nice = np->nice_base = p->nice_base;
+    np->vruntime = p->vruntime;
+    sched_group_join(np, p->group >= 0 ? p->group : 0);
 
+    ptable_insert(np);
     acquire(&np->lock);
     np->state = RUNNABLE;
+    runq_add(np);
     release(&np->lock);
     KLOG_DEBUG("proc", "fork parent=%d child=%d", p->pid, np->pid);
 
     return np->pid;
 }
 
+// sched() 直接切换到下一个进程，不经过 scheduler() 上下文
+static int sched_direct = 1;
+
+// 没有可运行的进程：在 wfi 中等到下一个中断。关中断后再置 idle、检查队列，
+// 此后到来的 IPI 或时钟中断会让 wfi 立即返回，不会错过入队
+static void cpu_idle(void) {
+    struct cpu *c = mycpu();
+    intr_off();
+    c->idle = 1;
+    __sync_synchronize();
+    if (runq_total() > 0) {
+        c->idle = 0;
+        return;
+    }
+    uint64 start = r_time();
+    wfi();
+    c->idle = 0;
+    c->idle_time += r_time() - start;
+    c->nr_idle++;
+    // 回到 scheduler() 的循环开头开中断，处理叫醒本 CPU 的中断
+}
+
+// 在本 CPU 上运行 p，调用者持有 p->lock 且 p->state == RUNNABLE
+static void run_prepare(struct cpu *c, struct proc *p) {
+    p->state = RUNNING;
+    p->cpu = cpuid();
+    clock_resume();
+    sched_start(p);
+    c->proc = p;
+}
+
 void scheduler(void) {
     struct cpu *c = mycpu();
     c->proc = 0;
-    printf("scheduler: starting on cpu 0\n");
-    KLOG_INFO("sched", "scheduler active on cpu=%d", 0);
+    printf("scheduler: starting on cpu %d (hart %lu)\n", cpuid(), c->hartid);
+    KLOG_INFO("sched", "scheduler active on cpu=%d", cpuid());
     while(1) {
+        // 开着中断找进程：scheduler 上下文固定在本 hart 上，cpuid() 不会变；
+        // 随后 acquire(&p->lock) 记下 intena = 1，新进程在 proc_entry 中开中断运行
         intr_on();
-        for (struct proc *p = proc; p < &proc[NPROC]; p++) {
-            acquire(&p->lock);
-            if (p->state == RUNNABLE) {
-                p->state = RUNNING;
-                c->proc = p; 
-                swtch(&c->context, &p->context);
-                c->proc = 0; 
-            }
+        struct proc *p = c->next;
+        c->next = 0;
+        if (p == 0)
+            p = runq_take();
+        if (p == 0) {
+            cpu_idle();
+            continue;
+        }
+        // 出队后再拿 p->lock：若它刚在别的 CPU 上 yield 入队，
+        // 这里会等到它彻底切换走；状态复查防止运行非 RUNNABLE 的进程
+        acquire(&p->lock);
+        if (p->state != RUNNABLE) {
             release(&p->lock);
+            continue;
         }
+
+        run_prepare(c, p);
+        swtch(&c->context, &p->context);
+        c->proc = 0; 
+        switch_finish();
     }
 }
 
+// 切换到新的上下文之后调用：放开切换走的进程的锁。它在 swtch() 保存完
+// 上下文之前一直持有这把锁，其他 CPU 不会在它的栈还在使用时运行它
+void switch_finish(void) {
+    struct cpu *c = mycpu();
+    struct proc *prev = c->prev;
+    if (prev) {
+        c->prev = 0;
+        release(&prev->lock);
+    }
+}
+
+// 当前进程已不在 RUNNING 状态，切换到下一个进程。快速路径在这里直接摘下
+// 下一个可运行的进程并切换过去，省去进出 scheduler() 上下文的一次 swtch()；
+// 没有可运行的进程时才回到 scheduler() 空闲。
+// 这时同时持有 p->lock 和 next->lock：next 可能刚在别的 CPU 上 yield 入队、
+// 正持有自己的锁等着摘下 p，所以只能 tryacquire，失败时把 next 交给
+// scheduler()，由它在放开 p->lock 之后再等 next->lock
 void sched(void) {
     int intena;
     struct proc *p = myproc();
+    struct cpu *c = mycpu();
     if (!p->lock.locked) { printf("sched: lock not held\n"); while(1); }
     if (p->state == RUNNING) { printf("sched: state is RUNNING\n"); while(1); }
-    intena = mycpu()->intena;
-    swtch(&p->context, &mycpu()->context);
+    sched_stop(p);
+    intena = c->intena;
+
+    struct proc *next = sched_direct ? runq_take() : 0;
+    if (next == p) {
+        // yield() 刚入队的自己又被摘下：不用切换
+        p->state = RUNNING;
+        sched_start(p);
+        return;
+    }
+    if (next && tryacquire(&next->lock)) {
+        if (next->state == RUNNABLE) {
+            c->nr_switch_direct++;
+            c->prev = p;
+            run_prepare(c, next);
+            swtch(&p->context, &next->context);
+            switch_finish();
+            mycpu()->intena = intena;
+            return;
+        }
+        release(&next->lock);
+        next = 0;
+    }
+
+    c->nr_switch_sched++;
+    c->next = next;
+    c->prev = p;
+    swtch(&p->context, &c->context);
+    switch_finish();
     mycpu()->intena = intena;
 }
 
-void yield(void) {
+// 打开或关闭 sched() 的直接切换 (供测试比较)，返回原来的设置
+int sched_set_direct(int on) {
+    int old = sched_direct;
+    sched_direct = on;
+    return old;
+}
+
+static void yield_cpu(void) {
     struct proc *p = myproc();
     acquire(&p->lock);
     p->state = RUNNABLE;
+    runq_add(p);
     sched();
     release(&p->lock);
 }
 
+void yield(void) {
+    myproc()->nr_voluntary_switches++;
+    yield_cpu();
+}
+
+// 抢占当前进程，由 kerneltrap() 在中断前上下文可抢占时调用
+void preempt(void) {
+    myproc()->nr_involuntary_switches++;
+    yield_cpu();
+}
+
+// 在进程表中查找未退出的进程，调用者持有 ptable.lock；
+// 返回的进程在放开 ptable.lock 之前不会被回收
+static struct proc *ptable_find(int pid) {
+    for (struct proc *p = ptable.head; p; p = p->all_next) {
+        if (p->pid == pid && p->state != ZOMBIE)
+            return p;
+    }
+    return 0;
+}
+
+static void set_nice_base(struct proc *p, int nice) {
+    int inherited = p->nice < p->nice_base ? p->nice : NICE_MAX;
+    __atomic_store_n(&p->nice_base, nice, __ATOMIC_RELAXED);
+    // 正在继承更高的优先级时保留它，释放睡眠锁时再重新计算
+    sched_group_renice(p, inherited < nice ? inherited : nice);
+}
+
+// 设置进程的 nice 值，pid 为 0 表示当前进程；新的优先级在进程
+// 下次入队时生效。调度字段由调度器无锁读取，不需要 p->lock
+int setpriority(int pid, int nice) {
+    if (nice < NICE_MIN || nice > NICE_MAX)
+        return -1;
+    if (pid == 0) {
+        set_nice_base(myproc(), nice);
+        return 0;
+    }
+    acquire(&ptable.lock);
+    struct proc *p = ptable_find(pid);
+    if (p)
+        set_nice_base(p, nice);
+    release(&ptable.lock);
+    return p ? 0 : -1;
+}
+
+// 优先级继承：把 p 的有效 nice 值设为 nice，并立即按新的优先级调整它在
+// 运行队列中的位置，不等到下次入队。调用者保证 p 不会被回收 (持有 p 拥有
+// 的睡眠锁的 lk，或 p 就是当前进程)
+void pi_set_nice(struct proc *p, int nice) {
+    acquire(&p->lock);
+    if (p->nice != nice) {
+        sched_group_renice(p, nice);
+        runq_reprio(p);
+    }
+    release(&p->lock);
+}
+
+// 把进程移到 CFS 调度组 gid
+int setgroup(int pid, int gid) {
+    if (gid < 0 || gid >= NGROUP)
+        return -1;
+    if (pid == 0) {
+        sched_group_join(myproc(), gid);
+        return 0;
+    }
+    acquire(&ptable.lock);
+    struct proc *p = ptable_find(pid);
+    if (p)
+        sched_group_join(p, gid);
+    release(&ptable.lock);
+    return p ? 0 : -1;
+}
+
+// 把进程绑定到 cpu 上运行，cpu 为 -1 时解除绑定；在进程下次入队时生效
+int setaffinity(int pid, int cpu) {
+    if (cpu < -1 || cpu >= machine.ncpu)
+        return -1;
+    if (pid == 0) {
+        __atomic_store_n(&myproc()->allowed_cpu, cpu, __ATOMIC_RELAXED);
+        return 0;
+    }
+    acquire(&ptable.lock);
+    struct proc *p = ptable_find(pid);
+    if (p)
+        __atomic_store_n(&p->allowed_cpu, cpu, __ATOMIC_RELAXED);
+    release(&ptable.lock);
+    return p ? 0 : -1;
+}
+
 void exit(int status) {
     struct proc *p = myproc();
     KLOG_WARN("proc", "process %d exiting status=%d", p ? p->pid : -1, status);
@@ -214,10 +540,14 @@ void exit(int status) {
         iput(p->cwd);
         p->cwd = 0;
     }
+    // 父进程在 wait() 中持有 wait_lock 扫描并入睡，这里持有它唤醒，
+    // 父进程要么已经睡下，要么还没开始扫描、之后会看到 ZOMBIE
+    acquire(&wait_lock);
+    if (p->parent) wakeup(p->parent);
     acquire(&p->lock);
     p->state = ZOMBIE;
     p->xstate = status;
-    if (p->parent) wakeup(p->parent);
+    release(&wait_lock);
     sched();
     while(1);
 }
@@ -225,27 +555,33 @@ void exit(int status) {
 int wait(int *status) {
     struct proc *p = myproc();
     int havekids, pid;
-    acquire(&p->lock);
+    acquire(&wait_lock);
     while(1) {
         havekids = 0;
-        for (struct proc *cp = proc; cp < &proc[NPROC]; cp++) {
+        acquire(&ptable.lock);
+        for (struct proc *cp = ptable.head; cp; cp = cp->all_next) {
             if (cp->parent == p) {
                 if (cp->state == ZOMBIE) {
                     havekids = 1;
                     pid = cp->pid;
                     if (status) *status = cp->xstate;
+                    release(&ptable.lock);
+                    release(&wait_lock);
+                    // 等子进程在 exit() 中彻底切换走后再回收它的内核栈
+                    acquire(&cp->lock);
+                    release(&cp->lock);
                     freeproc(cp);
-                    release(&p->lock);
                     return pid;
                 }
                 havekids = 1;
             }
         }
+        release(&ptable.lock);
         if (!havekids) {
-            release(&p->lock);
+            release(&wait_lock);
             return -1;
         }
-        sleep(p, &p->lock);
+        sleep(p, &wait_lock);
     }
 }
 
@@ -253,22 +589,83 @@ void wait_process(int *status) { wait(status); }
 
 void sleep(void *chan, struct spinlock *lk) {
     struct proc *p = myproc();
-    if (lk != &p->lock) { acquire(&p->lock); release(lk); }
+    // 先标记 SLEEPING 并挂入等待队列再放开 lk：唤醒者拿到 lk 后一定能在桶里找到它
+    if (lk != &p->lock) acquire(&p->lock);
     p->chan = chan;
     p->state = SLEEPING;
+    p->nr_voluntary_switches++;
+
+    struct waitq *wq = waitq_of(chan);
+    acquire(&wq->lock);
+    p->wq_next = 0;
+    if (wq->tail)
+        wq->tail->wq_next = p;
+    else
+        wq->head = p;
+    wq->tail = p;
+    release(&wq->lock);
+
+    if (lk != &p->lock) release(lk);
     sched();
     p->chan = 0;
     if (lk != &p->lock) { release(&p->lock); acquire(lk); }
 }
 
-void wakeup(void *chan) {
-    for (struct proc *p = proc; p < &proc[NPROC]; p++) {
-        if (p != myproc()) {
-            acquire(&p->lock);
-            if (p->state == SLEEPING && p->chan == chan) {
-                p->state = RUNNABLE;
-            }
-            release(&p->lock);
+// 按睡眠的先后唤醒 chan 上至多 max 个等待者，返回唤醒的个数
+static int wakeup_n(void *chan, int max) {
+    struct waitq *wq = waitq_of(chan);
+    struct proc *list = 0, *last = 0;
+    int n = 0;
+
+    // 修改条件的一方持有条件锁，等待者挂入队列发生在它放开条件锁之前，
+    // 所以无锁读到空桶时确实没有需要唤醒的进程
+    if (wq->head == 0)
+        return 0;
+
+    acquire(&wq->lock);
+    struct proc *prev = 0, *p = wq->head;
+    while (p && n < max) {
+        struct proc *next = p->wq_next;
+        if (p->chan == chan) {
+            if (prev)
+                prev->wq_next = next;
+            else
+                wq->head = next;
+            if (wq->tail == p)
+                wq->tail = prev;
+            p->wq_next = 0;
+            if (last)
+                last->wq_next = p;
+            else
+                list = p;
+            last = p;
+            n++;
+        } else {
+            prev = p;
         }
+        p = next;
+    }
+    release(&wq->lock);
+
+    // 摘下的进程只有这里能唤醒。拿到 p->lock 时它一定已经在 sched() 中切换走了
+    while ((p = list) != 0) {
+        list = p->wq_next;
+        acquire(&p->lock);
+        if (p->state != SLEEPING || p->chan != chan)
+            panic("wakeup: waiter not sleeping");
+        p->state = RUNNABLE;
+        p->nr_wakeups++;
+        runq_add(p);
+        release(&p->lock);
     }
-}
\ No newline at end of file
+    return n;
+}
+
+void wakeup(void *chan) {
+    wakeup_n(chan, 0x7fffffff);
+}
+
+// 只唤醒等待最久的一个进程，用于每次只有一个等待者能前进的场合 (如睡眠锁)
+int wakeup_one(void *chan) {
+    return wakeup_n(chan, 1);
+}
@@ -7,6 +7,7 @@
 #include "param.h"
 #include "file.h"
 #include "fs.h"
+#include "timer.h"
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
@@ -72,9 +73,20 @@ struct cpu {
     struct context context;
     int ncli;
     int intena;
+    uint64 hartid;               // SBI/设备树中的 hart 编号
+    uint64 timer_deadline;       // 已设置的下一次时钟中断时刻 (time CSR)
+    uint64 nr_timer_irqs;        // 时钟中断次数
+    volatile int idle;           // 正在 wfi 中等待，入队者需要用 IPI 叫醒它
+    uint64 idle_time;            // 累计空闲时间 (time CSR)
+    uint64 nr_idle;              // 进入空闲的次数
+    uint64 nr_ipis;              // 收到的 IPI 次数
+    struct proc *prev;           // 刚切换走的进程，由切换到的上下文放开它的锁
+    struct proc *next;           // sched() 已摘下、交给 scheduler() 运行的进程
+    uint64 nr_switch_direct;     // sched() 直接切换到下一个进程的次数
+    uint64 nr_switch_sched;      // 经过 scheduler() 上下文切换的次数
 };
 
-extern struct cpu cpus[1];
+extern struct cpu cpus[NCPU];
 
 struct proc {
     struct spinlock lock;
@@ -94,8 +106,65 @@ struct proc {
     char name[16];
     struct file *ofile[NOFILE];
     struct inode *cwd;
+
+    struct proc *all_next;       // 进程表链表，受 ptable.lock 保护
+    struct proc *all_prev;
+
+    struct proc *rq_next;        // 运行队列链表，受所在 runq 的锁保护
+    struct proc *wq_next;        // 等待队列链表，受所在等待队列的锁保护
+    int rq_cpu;                  // 所在运行队列的 CPU，不在队列中为 -1，受该队列的锁保护
+    int cpu;                     // 上次运行所在的 CPU，新进程为 -1
+
+    int nice;                    // 有效 nice 值，决定基础优先级：nice_base 或继承来的更高优先级
+    int nice_base;               // setpriority() 设置的 nice 值，NICE_MIN..NICE_MAX
+    int prio;                    // 当前 MLFQ 优先级，0 最高
+    int slice_used;              // 在当前优先级上已用掉的节拍，睡眠不清零
+    uint boost_epoch;            // 上次提升优先级时的全局提升轮次
+    int allowed_cpu;             // 只能在该 CPU 上运行，-1 表示不限
+
+    int dl_runtime;              // EDF 参数 (节拍)，dl_runtime 为 0 表示不是实时进程
+    int dl_rel_deadline;
+    int dl_period;
+    int dl_cpu;                  // 准入时分配的 CPU
+    int dl_util;                 // 利用率 (千分比)
+    int dl_active;               // 当前在 EDF 调度类中
+    int dl_done;                 // 本周期的作业已完成
+    int dl_missed;               // 本周期的作业已记过错过截止时间
+    uint64 dl_deadline;          // 当前作业的绝对截止时间 (节拍)
+    uint64 dl_period_end;        // 下一个周期的开始 (节拍)
+    uint64 dl_budget;            // 当前作业剩余的运行时间 (time 单位)
+    uint64 dl_jobs;              // 完成的作业数
+    uint64 dl_misses;            // 错过截止时间的作业数
+
+    int group;                   // CFS 调度组
+    uint64 vruntime;             // CFS 虚拟运行时间
+    struct proc *cfs_left;       // CFS 运行队列 AVL 树，受所在 runq 的锁保护
+    struct proc *cfs_right;
+    int cfs_height;
+
+    uint64 enqueue_time;         // 最近一次进入运行队列的时刻 (time CSR)
+    uint64 exec_start;           // 本次开始运行的时刻，不在运行时为 0
+    uint64 sum_exec_runtime;     // 累计运行时间
+    uint64 run_delay;            // 在运行队列中等待的累计时间
+    uint64 nr_runs;              // 被调度运行的次数
+
+    struct sleeplock *held_locks;   // 持有的睡眠锁链表，只由进程自己修改
+    struct sleeplock *blocked_on;   // 正在排队等待的睡眠锁，受该锁的 lk 保护
+
+    struct timer sleep_timer;    // sleep_until() 使用的定时器
+    uint64 nr_wakeups;           // 被 wakeup() 唤醒的次数
+
+    uint64 nr_voluntary_switches;   // 主动让出 CPU (yield/sleep) 的次数
+    uint64 nr_involuntary_switches; // 时间片用完被抢占的次数
+};
+
+struct ptable {
+    struct spinlock lock;
+    struct proc *head;
+    struct proc *tail;
+    int count;
 };
 
-extern struct proc proc[NPROC];
+extern struct ptable ptable;
 
 #endif // __PROC_H__
\ No newline at end of file
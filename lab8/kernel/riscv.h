@@ -21,6 +21,9 @@ typedef uint64 *pagetable_t; // 页表
 #define PGSIZE 4096 // 每个页的大小 (4KB)
 #define PGSHIFT 12  // log2(PGSIZE)
 
+// 物理内存 (DRAM) 起始地址，内核从 KERNBASE + 2MB 处开始 (之前是 OpenSBI)
+#define KERNBASE 0x80000000L
+
 // 将地址向下/向上对齐到页边界
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
@@ -54,10 +57,16 @@ typedef uint64 *pagetable_t; // 页表
 
 // sstatus (Supervisor Status Register)
 #define SSTATUS_SIE (1L << 1) // Supervisor Interrupt Enable bit
+#define SSTATUS_SPIE (1L << 5) // 陷入前的 SIE
+#define SSTATUS_SPP (1L << 8)  // 陷入前的特权级 (1 = S 模式)
 
 // sie (Supervisor Interrupt Enable Register)
+#define SIE_SSIE (1L << 1) // Supervisor Software Interrupt Enable bit (IPI)
 #define SIE_STIE (1L << 5) // Supervisor Timer Interrupt Enable bit
 
+// sip (Supervisor Interrupt Pending Register)
+#define SIP_SSIP (1L << 1) // 软件中断 (IPI) 待处理
+
 //
 // 用于读写 RISC-V 控制寄存器的内联汇编函数
 //
@@ -91,6 +100,22 @@ static inline void w_sie(uint64 x) {
     asm volatile("csrw sie, %0" : : "r" (x));
 }
 
+// 读写 sip 寄存器
+static inline uint64 r_sip() {
+    uint64 x;
+    asm volatile("csrr %0, sip" : "=r" (x));
+    return x;
+}
+
+static inline void w_sip(uint64 x) {
+    asm volatile("csrw sip, %0" : : "r" (x));
+}
+
+// 等待中断：有 sie 中允许的中断待处理时返回，与 sstatus.SIE 无关
+static inline void wfi() {
+    asm volatile("wfi");
+}
+
 // 读取 scause (Supervisor Cause) 寄存器
 static inline uint64 r_scause() {
     uint64 x;
@@ -143,4 +168,27 @@ static inline uint64 r_time() {
     return x;
 }
 
+static inline uint64 r_cycle() {
+    uint64 x;
+    asm volatile("csrr %0, cycle" : "=r" (x));
+    return x;
+}
+
+// Sstc 扩展的 S 模式时钟比较寄存器，time >= stimecmp 时置位 STIP
+static inline void w_stimecmp(uint64 x) {
+    asm volatile("csrw 0x14d, %0" : : "r" (x));
+}
+
+// tp 寄存器保存本 hart 的 CPU 编号 (cpus[] 下标)，由 entry.S 设置，
+// 内核中的其他代码不会修改它
+static inline uint64 r_tp() {
+    uint64 x;
+    asm volatile("mv %0, tp" : "=r" (x));
+    return x;
+}
+
+static inline void w_tp(uint64 x) {
+    asm volatile("mv tp, %0" : : "r" (x));
+}
+
 #endif // __RISCV_H__
\ No newline at end of file
@@ -0,0 +1,508 @@
+// kernel/sched.c
+// 每 CPU 运行队列：只保存 RUNNABLE 进程，调度开销与系统中的进程总数无关。
+// 本地队列为空的 CPU 从其他队列中窃取。队列内部如何组织由调度类决定：
+// 默认是下面的多级反馈队列 (MLFQ)，也可以在编译时 (make SCHED=cfs)
+// 或启动参数 (sched=cfs) 中选择 cfs.c 中按虚拟运行时间公平分配的 CFS。
+// edf.c 中的实时调度类优先于这两者。
+//
+// 锁顺序为 p->lock -> runq.lock。scheduler() 在队列锁下摘下进程、放开
+// 队列锁之后才获取 p->lock；yield() 在切换走之前就已入队，其他 CPU
+// 摘到它后会在 p->lock 上等到它彻底切换走为止。
+#include "defs.h"
+#include "sched.h"
+
+static struct runq runqs[NCPU];
+
+// 当前调度类，只在持有全部队列锁时切换
+static const struct sched_class *policy = &mlfq_sched_class;
+
+static const struct sched_class *sched_classes[] = {
+    &mlfq_sched_class,
+    &cfs_sched_class,
+};
+
+// 时间片长度 (时钟节拍数)，0 表示关闭抢占
+static int sched_quantum = SCHED_QUANTUM;
+
+static const struct sched_class *sched_lookup(const char *name) {
+    for (int i = 0; i < sizeof(sched_classes) / sizeof(sched_classes[0]); i++) {
+        if (strncmp(sched_classes[i]->name, name, 16) == 0)
+            return sched_classes[i];
+    }
+    return 0;
+}
+
+void runq_init(void) {
+#ifdef SCHED_DEFAULT_CFS
+    policy = &cfs_sched_class;
+#endif
+    char name[16];
+    if (fdt_bootarg("sched", name, sizeof(name)) >= 0) {
+        const struct sched_class *cls = sched_lookup(name);
+        if (cls)
+            policy = cls;
+        else
+            printf("sched: unknown class '%s', using %s\n", name, policy->name);
+    }
+    sched_group_init();
+    edf_init();
+    for (int i = 0; i < NCPU; i++) {
+        spinlock_init(&runqs[i].lock, "runq");
+        runqs[i].nr = 0;
+        edf_sched_class.init(&runqs[i]);
+        policy->init(&runqs[i]);
+    }
+    printf("sched: %s scheduling class\n", policy->name);
+}
+
+// 进程所在的调度类，p->dl_active 在入队时决定
+static const struct sched_class *class_of(struct proc *p) {
+    return p->dl_active ? &edf_sched_class : policy;
+}
+
+// 运行中的进程 p 记账到 now，调用者在 p 所在的 CPU 上关中断
+static void sched_charge(struct proc *p, uint64 now) {
+    uint64 delta = now - p->exec_start;
+    p->exec_start = now;
+    p->sum_exec_runtime += delta;
+    class_of(p)->account(&runqs[p->cpu], p, delta);
+}
+
+// scheduler() 即将运行 p，持有 p->lock
+void sched_start(struct proc *p) {
+    uint64 now = r_time();
+    p->run_delay += now - p->enqueue_time;
+    p->nr_runs++;
+    p->exec_start = now;
+}
+
+// 当前进程停止运行 (让出、睡眠或退出)，持有 p->lock。
+// 必须在进程重新入队之前完成，调度类的排序键可能依赖于记账结果
+void sched_stop(struct proc *p) {
+    if (p->exec_start) {
+        sched_charge(p, r_time());
+        p->exec_start = 0;
+    }
+}
+
+// 入队之后叫醒空闲的 CPU：目标 CPU 空闲就叫醒它，否则叫醒一个空闲 CPU 来窃取
+// (实时进程和绑定了 CPU 的进程不能被窃取)。与 cpu_idle() 配对：入队在前、
+// 检查 idle 在后，空闲的一方先置 idle 再检查队列，总有一方能看到对方
+static void runq_kick(struct proc *p, int cpu) {
+    __sync_synchronize();
+    int self = cpuid();
+    if (cpu != self && cpu_kick(cpu))
+        return;
+    if (p->dl_active || p->allowed_cpu >= 0)
+        return;
+    for (int i = 0; i < machine.ncpu; i++) {
+        if (i != self && i != cpu && cpus[i].idle && cpu_kick(i))
+            return;
+    }
+}
+
+// 放入 CPU 的运行队列：实时进程和绑定了 CPU 的进程放到指定 CPU，否则优先
+// 放回上次运行的 CPU (缓存仍然是热的)，新进程放在当前 CPU。
+// 调用者持有 p->lock 且 p->state == RUNNABLE
+void runq_add(struct proc *p) {
+    int cpu;
+    if (p->dl_runtime)
+        cpu = p->dl_cpu;
+    else if (p->allowed_cpu >= 0)
+        cpu = p->allowed_cpu;
+    else if (p->cpu >= 0 && p->cpu < machine.ncpu)
+        cpu = p->cpu;
+    else
+        cpu = cpuid();
+    struct runq *rq = &runqs[cpu];
+
+    sched_stop(p);
+    if (p->cpu >= 0 && p->cpu != cpu)
+        policy->migrate(p, &runqs[p->cpu], rq);
+    p->enqueue_time = r_time();
+    p->dl_active = edf_eligible(p);
+
+    acquire(&rq->lock);
+    class_of(p)->enqueue(rq, p);
+    p->rq_cpu = cpu;
+    rq->nr++;
+    rq->nr_enqueued++;
+    release(&rq->lock);
+    runq_kick(p, cpu);
+}
+
+// p 的有效 nice 值刚被修改 (优先级继承)，让调度类立即调整它的位置，
+// 被提升的锁持有者不必等到下次入队才能得到 CPU。调用者持有 p->lock，
+// 所以 p 不会被放进别的队列，只可能被摘下
+void runq_reprio(struct proc *p) {
+    if (p->dl_active)
+        return;
+    int cpu = p->rq_cpu;
+    if (cpu >= 0) {
+        struct runq *rq = &runqs[cpu];
+        acquire(&rq->lock);
+        if (p->rq_cpu == cpu) {
+            policy->reprio(rq, p);
+            release(&rq->lock);
+            return;
+        }
+        release(&rq->lock);
+    }
+    policy->reprio(0, p);
+}
+
+// 从 rq 摘下一个允许在 cpu 上运行的进程，调用者持有 rq->lock
+static struct proc *runq_pop(struct runq *rq, int cpu) {
+    if (rq->nr == 0)
+        return 0;
+    struct proc *p = edf_sched_class.dequeue(rq, cpu);
+    if (p == 0)
+        p = policy->dequeue(rq, cpu);
+    if (p) {
+        p->rq_cpu = -1;
+        rq->nr--;
+    }
+    return p;
+}
+
+// 从其他 CPU 的队列中窃取一个可以在本 CPU 上运行的进程
+static struct proc *runq_steal(int self) {
+    // 无锁读取队列长度跳过空队列，只有确实要窃取时才加锁
+    for (int k = 1; k < machine.ncpu; k++) {
+        int victim = (self + k) % machine.ncpu;
+        struct runq *rq = &runqs[victim];
+        if (rq->nr == 0)
+            continue;
+        acquire(&rq->lock);
+        struct proc *p = runq_pop(rq, self);
+        if (p)
+            rq->nr_stolen++;
+        release(&rq->lock);
+        if (p) {
+            policy->migrate(p, rq, &runqs[self]);
+            return p;
+        }
+    }
+    return 0;
+}
+
+// 取下一个要运行的进程：先本地队列，再窃取；没有可运行进程时返回 0。
+// 两处调用，调用期间 cpuid() 都不会变：
+//  - scheduler()：开着中断，不持有任何锁，调度上下文固定在本 hart 上；
+//  - sched() 的直接切换：持有当前进程的 p->lock (因而已关中断)，运行在它的
+//    内核栈上，yield() 刚入队的 p 自己也可能被取回。
+// 这里只拿队列锁，队列操作中不会再拿进程锁，所以 p->lock 之后拿队列锁不会死锁；
+// 返回的进程没有加锁，调用者拿到它的锁后还要复查状态
+struct proc *runq_take(void) {
+    int self = cpuid();
+    struct runq *rq = &runqs[self];
+    struct proc *p = 0;
+
+    if (rq->nr > 0) {
+        acquire(&rq->lock);
+        p = runq_pop(rq, self);
+        release(&rq->lock);
+    }
+    if (p == 0)
+        p = runq_steal(self);
+    return p;
+}
+
+// 所有 CPU 运行队列中的进程总数
+int runq_total(void) {
+    int n = 0;
+    for (int i = 0; i < machine.ncpu; i++) {
+        n += runqs[i].nr;
+    }
+    return n;
+}
+
+// 切换调度类：锁住全部队列，按旧调度类的顺序取出所有进程放进新调度类。
+// 正在运行的进程在下次入队时进入新调度类
+int sched_set_policy(const char *name) {
+    const struct sched_class *cls = sched_lookup(name);
+    if (cls == 0)
+        return -1;
+
+    for (int i = 0; i < NCPU; i++) {
+        acquire(&runqs[i].lock);
+    }
+    if (cls != policy) {
+        for (int i = 0; i < NCPU; i++) {
+            struct runq *rq = &runqs[i];
+            struct proc *head = 0, *tail = 0, *p;
+            while ((p = policy->dequeue(rq, -1)) != 0) {
+                p->rq_next = 0;
+                if (tail)
+                    tail->rq_next = p;
+                else
+                    head = p;
+                tail = p;
+            }
+            cls->init(rq);
+            while ((p = head) != 0) {
+                head = p->rq_next;
+                cls->enqueue(rq, p);
+            }
+        }
+        policy = cls;
+    }
+    for (int i = NCPU - 1; i >= 0; i--) {
+        release(&runqs[i].lock);
+    }
+    return 0;
+}
+
+const char *sched_policy_name(void) {
+    return policy->name;
+}
+
+void sched_set_quantum(int ticks) {
+    sched_quantum = ticks < 0 ? 0 : ticks;
+}
+
+int sched_get_quantum(void) {
+    return sched_quantum;
+}
+
+// 由时钟中断调用：给当前进程记账，由调度类决定是否抢占它，返回 1 表示应当抢占。
+// 本地有实时作业等待时总是抢占普通进程。调用者已关中断
+int sched_tick(void) {
+    struct runq *rq = &runqs[cpuid()];
+    struct proc *p = mycpu()->proc;
+    if (p && p->exec_start)
+        sched_charge(p, r_time());
+    if (p && p->dl_active) {
+        policy->tick(rq, 0);
+        return edf_sched_class.tick(rq, p);
+    }
+    int resched = policy->tick(rq, p);
+    return resched || (p && rq->edf.nr > 0);
+}
+
+// 所有 CPU 上 MLFQ 各优先级的可运行进程数，nr 至少有 MLFQ_LEVELS 项
+void runq_level_lengths(int *nr) {
+    for (int l = 0; l < MLFQ_LEVELS; l++) {
+        nr[l] = 0;
+        for (int i = 0; i < machine.ncpu; i++) {
+            nr[l] += runqs[i].mlfq.nr_level[l];
+        }
+    }
+}
+
+void sched_dump_stats(void) {
+    printf("=== Run Queues (%s) ===\n", policy->name);
+    for (int i = 0; i < machine.ncpu; i++) {
+        struct runq *rq = &runqs[i];
+        printf("  cpu%d: runnable=%d enqueued=%lu stolen=%lu idle=%lums (%lu times, %lu ipis) "
+               "switches direct=%lu via scheduler=%lu ",
+               i, rq->nr, rq->nr_enqueued, rq->nr_stolen,
+               cpus[i].idle_time * 1000 / machine.timebase, cpus[i].nr_idle, cpus[i].nr_ipis,
+               cpus[i].nr_switch_direct, cpus[i].nr_switch_sched);
+        edf_sched_class.dump(rq);
+        policy->dump(rq);
+        printf("\n");
+    }
+}
+
+// ---------------------------------------------------------------------------
+// 多级反馈队列：每个队列按优先级分成 MLFQ_LEVELS 级 FIFO
+//  - 总是运行最高非空级中的进程，第 l 级的时间片为 sched_quantum << l 个节拍；
+//  - 进程在某一级累计用满时间片就降一级，睡眠不会清零已用的节拍，
+//    所以频繁睡眠的交互进程留在高优先级，计算密集的进程逐步沉到底层；
+//  - 每 MLFQ_BOOST_TICKS 个节拍把所有进程提回基础优先级，底层进程不会饿死；
+//  - nice 值决定基础优先级，nice > 0 的批处理进程从较低的级别开始。
+
+// 全局提升轮次，等于 get_ticks() / MLFQ_BOOST_TICKS，由任意 CPU 的时钟中断更新
+static volatile uint boost_epoch;
+
+// nice <= 0 从最高级开始，nice 1..NICE_MAX 线性映射到 1..MLFQ_LEVELS-1 级
+static int mlfq_base(int nice) {
+    if (nice <= 0)
+        return 0;
+    return 1 + (nice - 1) * (MLFQ_LEVELS - 1) / NICE_MAX;
+}
+
+// 把进程的优先级重置为基础优先级；调用者独占访问 p 的调度字段
+// (持有 p->lock，或进程在本 CPU 上运行，或进程在持锁的队列中)
+static void mlfq_reset(struct proc *p, uint epoch) {
+    p->prio = mlfq_base(p->nice);
+    p->slice_used = 0;
+    p->boost_epoch = epoch;
+}
+
+static void mlfq_init(struct runq *rq) {
+    for (int l = 0; l < MLFQ_LEVELS; l++) {
+        rq->mlfq.head[l] = rq->mlfq.tail[l] = 0;
+        rq->mlfq.nr_level[l] = 0;
+    }
+    rq->mlfq.epoch = boost_epoch;
+}
+
+// 挂到第 l 级队尾
+static void level_append(struct mlfq_rq *q, int l, struct proc *p) {
+    p->rq_next = 0;
+    if (q->tail[l])
+        q->tail[l]->rq_next = p;
+    else
+        q->head[l] = p;
+    q->tail[l] = p;
+    q->nr_level[l]++;
+}
+
+// 从第 l 级队列中摘下 p
+static void level_remove(struct mlfq_rq *q, int l, struct proc *p) {
+    struct proc *prev = 0;
+    for (struct proc *n = q->head[l]; n; prev = n, n = n->rq_next) {
+        if (n != p)
+            continue;
+        if (prev)
+            prev->rq_next = p->rq_next;
+        else
+            q->head[l] = p->rq_next;
+        if (q->tail[l] == p)
+            q->tail[l] = prev;
+        p->rq_next = 0;
+        q->nr_level[l]--;
+        return;
+    }
+    panic("mlfq: process not in its level");
+}
+
+// 全局提升之后第一次访问队列时，把其中的进程按基础优先级重新排队，
+// 各级内部保持原有的先后顺序
+static void mlfq_boost(struct mlfq_rq *q, uint epoch) {
+    struct proc *list[MLFQ_LEVELS];
+    for (int l = 0; l < MLFQ_LEVELS; l++) {
+        list[l] = q->head[l];
+        q->head[l] = q->tail[l] = 0;
+        q->nr_level[l] = 0;
+    }
+    for (int l = 0; l < MLFQ_LEVELS; l++) {
+        struct proc *p = list[l];
+        while (p) {
+            struct proc *next = p->rq_next;
+            mlfq_reset(p, epoch);
+            level_append(q, p->prio, p);
+            p = next;
+        }
+    }
+    q->epoch = epoch;
+}
+
+static void mlfq_enqueue(struct runq *rq, struct proc *p) {
+    struct mlfq_rq *q = &rq->mlfq;
+    uint epoch = boost_epoch;
+
+    if (q->epoch != epoch)
+        mlfq_boost(q, epoch);
+    if (p->boost_epoch != epoch || p->prio >= MLFQ_LEVELS) {
+        mlfq_reset(p, epoch);
+    } else if (p->prio < mlfq_base(p->nice)) {
+        // nice 值调大之后不再享有原来的优先级
+        p->prio = mlfq_base(p->nice);
+    }
+    level_append(q, p->prio, p);
+}
+
+// 从最高非空级中摘下第一个允许在 cpu 上运行的进程
+static struct proc *mlfq_dequeue(struct runq *rq, int cpu) {
+    struct mlfq_rq *q = &rq->mlfq;
+
+    if (q->epoch != boost_epoch)
+        mlfq_boost(q, boost_epoch);
+    for (int l = 0; l < MLFQ_LEVELS; l++) {
+        struct proc *prev = 0;
+        for (struct proc *p = q->head[l]; p; prev = p, p = p->rq_next) {
+            if (cpu >= 0 && p->allowed_cpu >= 0 && p->allowed_cpu != cpu)
+                continue;
+            if (prev)
+                prev->rq_next = p->rq_next;
+            else
+                q->head[l] = p->rq_next;
+            if (q->tail[l] == p)
+                q->tail[l] = prev;
+            p->rq_next = 0;
+            q->nr_level[l]--;
+            return p;
+        }
+    }
+    return 0;
+}
+
+// 时间片按节拍计算，不需要按时间记账
+static void mlfq_account(struct runq *rq, struct proc *p, uint64 delta) {
+}
+
+static void mlfq_migrate(struct proc *p, struct runq *from, struct runq *to) {
+}
+
+// 当前进程用完了本级的时间片且有其他进程在等待，
+// 或本地队列中出现了更高优先级的进程时抢占它
+static int mlfq_tick(struct runq *rq, struct proc *p) {
+    // 按全局节拍计算，空闲时停掉节拍的 CPU 不会推迟提升
+    uint now_epoch = get_ticks() / MLFQ_BOOST_TICKS;
+    if (boost_epoch != now_epoch)
+        boost_epoch = now_epoch;
+    if (p == 0 || sched_quantum == 0)
+        return 0;
+
+    uint epoch = boost_epoch;
+    if (p->boost_epoch != epoch)
+        mlfq_reset(p, epoch);
+
+    if (++p->slice_used >= (sched_quantum << p->prio)) {
+        // 继承了优先级的锁持有者不降级，放开锁恢复原来的 nice 值时再说
+        if (p->prio < MLFQ_LEVELS - 1 && p->nice >= p->nice_base)
+            p->prio++;
+        p->slice_used = 0;
+        return runq_total() > 0;
+    }
+
+    // 无锁读取：刚被唤醒的高优先级进程最迟在下一个节拍得到 CPU
+    for (int l = 0; l < p->prio; l++) {
+        if (rq->mlfq.nr_level[l] > 0)
+            return 1;
+    }
+    return 0;
+}
+
+// 继承了更高优先级的进程至少排在新的基础优先级上；恢复原优先级时
+// 不再享有继承来的级别。在队列中的进程移到对应级别的队尾
+static void mlfq_reprio(struct runq *rq, struct proc *p) {
+    if (rq && rq->mlfq.epoch != boost_epoch)
+        mlfq_boost(&rq->mlfq, boost_epoch);
+    int base = mlfq_base(p->nice);
+    int prio = p->prio;
+    if (prio < base || (p->nice < p->nice_base && prio > base))
+        prio = base;
+    if (prio == p->prio)
+        return;
+    if (rq == 0) {
+        p->prio = prio;
+        return;
+    }
+    level_remove(&rq->mlfq, p->prio, p);
+    p->prio = prio;
+    level_append(&rq->mlfq, prio, p);
+}
+
+static void mlfq_dump(struct runq *rq) {
+    printf("levels=[");
+    for (int l = 0; l < MLFQ_LEVELS; l++) {
+        printf(l ? " %d" : "%d", rq->mlfq.nr_level[l]);
+    }
+    printf("] boost epoch %u", boost_epoch);
+}
+
+const struct sched_class mlfq_sched_class = {
+    .name = "mlfq",
+    .init = mlfq_init,
+    .enqueue = mlfq_enqueue,
+    .dequeue = mlfq_dequeue,
+    .account = mlfq_account,
+    .migrate = mlfq_migrate,
+    .tick = mlfq_tick,
+    .reprio = mlfq_reprio,
+    .dump = mlfq_dump,
+};
@@ -0,0 +1,70 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+
+struct proc;
+struct runq;
+
+// 调度类：决定运行队列中进程的组织方式和抢占策略。
+// enqueue/dequeue/init 在持有 rq->lock 时调用；account/tick 在进程所在的
+// CPU 上关中断调用，此时进程不在任何运行队列中
+struct sched_class {
+    const char *name;
+    void (*init)(struct runq *rq);
+    void (*enqueue)(struct runq *rq, struct proc *p);
+    // 摘下一个允许在 cpu 上运行的进程，cpu 为 -1 时不检查亲和性
+    struct proc *(*dequeue)(struct runq *rq, int cpu);
+    // 进程刚运行了 delta 个 time 单位
+    void (*account)(struct runq *rq, struct proc *p, uint64 delta);
+    // 进程从 from 的队列转到 to 的队列，调用者不持有队列锁
+    void (*migrate)(struct proc *p, struct runq *from, struct runq *to);
+    // 时钟节拍，p 为当前进程 (可能为 0)；返回 1 表示应当抢占
+    int (*tick)(struct runq *rq, struct proc *p);
+    // 进程的有效 nice 值因优先级继承而改变。进程在 rq 中时持有 rq->lock，
+    // 不在任何队列中时 rq 为 0
+    void (*reprio)(struct runq *rq, struct proc *p);
+    void (*dump)(struct runq *rq);
+};
+
+// 多级反馈队列
+struct mlfq_rq {
+    struct proc *head[MLFQ_LEVELS];
+    struct proc *tail[MLFQ_LEVELS];
+    int nr_level[MLFQ_LEVELS];
+    uint epoch;                 // 队列中进程的优先级对应的提升轮次
+};
+
+// EDF：按截止时间排序的链表
+struct edf_rq {
+    struct proc *head;
+    int nr;
+};
+
+// CFS：按虚拟运行时间排序的 AVL 树
+struct cfs_rq {
+    struct proc *root;
+    uint64 min_vruntime;        // 单调不减，新入队/迁入进程以它为基准
+    uint64 leftmost;            // 树中最小的 vruntime，供 tick 无锁读取
+};
+
+struct runq {
+    struct spinlock lock;
+    int nr;
+    uint64 nr_enqueued;
+    uint64 nr_stolen;           // 被其他 CPU 窃取走的进程数
+    struct edf_rq edf;
+    struct mlfq_rq mlfq;
+    struct cfs_rq cfs;
+};
+
+extern const struct sched_class edf_sched_class;
+extern const struct sched_class mlfq_sched_class;
+extern const struct sched_class cfs_sched_class;
+
+void edf_init(void);
+int edf_eligible(struct proc *p);
+
+#endif // __SCHED_H__
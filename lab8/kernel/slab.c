@@ -0,0 +1,223 @@
+// kernel/slab.c
+// slab 对象缓存：在伙伴系统之上为固定大小的内核对象提供分配器
+#include "defs.h"
+#include "slab.h"
+
+#define NCACHE 16
+
+// 缓存描述符本身来自静态池，避免自举问题
+static struct {
+    struct spinlock lock;
+    struct kmem_cache pool[NCACHE];
+    int ncaches;
+    struct kmem_cache *head;
+} slab_caches;
+
+static void slab_list_init(struct slab *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static int slab_list_empty(struct slab *head) {
+    return head->next == head;
+}
+
+static void slab_list_del(struct slab *s) {
+    s->prev->next = s->next;
+    s->next->prev = s->prev;
+}
+
+static void slab_list_add(struct slab *head, struct slab *s) {
+    s->next = head->next;
+    s->prev = head;
+    head->next->prev = s;
+    head->next = s;
+}
+
+// slab 头部之后紧跟一个空闲对象下标栈；对象本身不被用来串链表，
+// 这样释放回来的对象可以保持构造后的状态
+static inline ushort *slab_freeidx(struct slab *s) {
+    return (ushort*)(s + 1);
+}
+
+static inline char *slab_obj(struct kmem_cache *c, struct slab *s, int idx) {
+    return (char*)s + c->offset + (uint64)idx * c->size;
+}
+
+static inline struct slab *obj_to_slab(struct kmem_cache *c, void *obj) {
+    return (struct slab*)((uint64)obj & ~(((uint64)PGSIZE << c->order) - 1));
+}
+
+void slab_init(void) {
+    spinlock_init(&slab_caches.lock, "slab_caches");
+    slab_caches.ncaches = 0;
+    slab_caches.head = 0;
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, uint size, uint align, void (*ctor)(void *)) {
+    if (align < sizeof(uint64))
+        align = sizeof(uint64);
+    size = (size + align - 1) & ~(align - 1);
+
+    acquire(&slab_caches.lock);
+    if (slab_caches.ncaches == NCACHE) {
+        release(&slab_caches.lock);
+        panic("kmem_cache_create: too many caches");
+    }
+    struct kmem_cache *c = &slab_caches.pool[slab_caches.ncaches++];
+    release(&slab_caches.lock);
+
+    memset(c, 0, sizeof(*c));
+    spinlock_init(&c->lock, "kmem_cache");
+    safestrcpy(c->name, name, SLAB_NAME_MAX);
+    c->size = size;
+    c->ctor = ctor;
+
+    // 选择能放下至少 SLAB_MIN_OBJS 个对象的最小 slab
+    for (c->order = 0; ; c->order++) {
+        uint64 slabsize = (uint64)PGSIZE << c->order;
+        int n = (slabsize - sizeof(struct slab)) / (size + sizeof(ushort));
+        while (n > 0) {
+            uint64 off = sizeof(struct slab) + n * sizeof(ushort);
+            off = (off + align - 1) & ~((uint64)align - 1);
+            if (off + (uint64)n * size <= slabsize) {
+                c->offset = off;
+                break;
+            }
+            n--;
+        }
+        c->objs_per_slab = n;
+        if (n >= SLAB_MIN_OBJS || c->order == MAX_ORDER - 1)
+            break;
+    }
+    if (c->objs_per_slab == 0)
+        panic("kmem_cache_create: object too large");
+
+    slab_list_init(&c->partial);
+    slab_list_init(&c->full);
+    slab_list_init(&c->empty);
+
+    acquire(&slab_caches.lock);
+    c->next = slab_caches.head;
+    slab_caches.head = c;
+    release(&slab_caches.lock);
+    return c;
+}
+
+// 新建一个 slab 并构造其中所有对象，调用者持有 c->lock
+static struct slab *cache_grow(struct kmem_cache *c) {
+    struct slab *s = (struct slab*)kalloc_pages(c->order);
+    if (s == 0)
+        return 0;
+    s->cache = c;
+    s->inuse = 0;
+    ushort *freeidx = slab_freeidx(s);
+    for (int i = 0; i < c->objs_per_slab; i++) {
+        freeidx[i] = c->objs_per_slab - 1 - i;
+        if (c->ctor)
+            c->ctor(slab_obj(c, s, i));
+    }
+    slab_list_add(&c->empty, s);
+    c->nr_empty++;
+    c->nr_slabs++;
+    return s;
+}
+
+// 从 slab 中取一个对象，调用者持有 c->lock
+static void *slab_take(struct kmem_cache *c) {
+    struct slab *s;
+
+    if (!slab_list_empty(&c->partial)) {
+        s = c->partial.next;
+    } else {
+        if (slab_list_empty(&c->empty) && cache_grow(c) == 0)
+            return 0;
+        s = c->empty.next;
+        c->nr_empty--;
+    }
+
+    int idx = slab_freeidx(s)[c->objs_per_slab - 1 - s->inuse];
+    s->inuse++;
+    slab_list_del(s);
+    slab_list_add(s->inuse == c->objs_per_slab ? &c->full : &c->partial, s);
+    return slab_obj(c, s, idx);
+}
+
+// 把对象放回所属 slab，调用者持有 c->lock
+static void slab_put(struct kmem_cache *c, void *obj) {
+    struct slab *s = obj_to_slab(c, obj);
+    if (s->cache != c)
+        panic("kmem_cache_free: object from another cache");
+
+    int idx = ((char*)obj - slab_obj(c, s, 0)) / c->size;
+    s->inuse--;
+    slab_freeidx(s)[c->objs_per_slab - 1 - s->inuse] = idx;
+    slab_list_del(s);
+    if (s->inuse > 0) {
+        slab_list_add(&c->partial, s);
+        return;
+    }
+    // 保留一个空 slab 以免在边界上反复申请/释放页，多余的还给伙伴系统
+    if (c->nr_empty > 0) {
+        c->nr_slabs--;
+        kfree_pages(s, c->order);
+        return;
+    }
+    slab_list_add(&c->empty, s);
+    c->nr_empty++;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *c) {
+    void *obj = 0;
+
+    push_off();
+    struct kmem_magazine *mag = &c->mag[cpuid()];
+    if (mag->count == 0) {
+        // 弹匣空了：一次持锁装填半个弹匣
+        acquire(&c->lock);
+        while (mag->count < SLAB_MAGAZINE / 2) {
+            void *o = slab_take(c);
+            if (o == 0)
+                break;
+            mag->objs[mag->count++] = o;
+        }
+        release(&c->lock);
+    }
+    if (mag->count > 0)
+        obj = mag->objs[--mag->count];
+    pop_off();
+
+    if (obj)
+        __atomic_fetch_add(&c->nr_allocs, 1, __ATOMIC_RELAXED);
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *c, void *obj) {
+    if (obj == 0)
+        return;
+    __atomic_fetch_add(&c->nr_frees, 1, __ATOMIC_RELAXED);
+
+    push_off();
+    struct kmem_magazine *mag = &c->mag[cpuid()];
+    if (mag->count == SLAB_MAGAZINE) {
+        // 弹匣满了：一次持锁把一半对象还给 slab
+        acquire(&c->lock);
+        while (mag->count > SLAB_MAGAZINE / 2) {
+            slab_put(c, mag->objs[--mag->count]);
+        }
+        release(&c->lock);
+    }
+    mag->objs[mag->count++] = obj;
+    pop_off();
+}
+
+void kmem_cache_dump(void) {
+    printf("=== Slab Caches ===\n");
+    acquire(&slab_caches.lock);
+    for (struct kmem_cache *c = slab_caches.head; c; c = c->next) {
+        printf("  %s: size=%d objs/slab=%d order=%d slabs=%lu active=%lu allocs=%lu\n",
+               c->name, c->size, c->objs_per_slab, c->order, c->nr_slabs,
+               c->nr_allocs - c->nr_frees, c->nr_allocs);
+    }
+    release(&slab_caches.lock);
+}
@@ -0,0 +1,56 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+
+#define SLAB_NAME_MAX   16
+#define SLAB_MAGAZINE   16      // 每 CPU 弹匣可缓存的对象数
+#define SLAB_MIN_OBJS   8       // 每个 slab 至少容纳的对象数，不足时增大 slab 的阶
+
+// 一个 slab 占用 2^order 个物理连续页，头部存放本结构体和空闲下标栈，其后是对象
+struct slab {
+    struct slab *next;
+    struct slab *prev;
+    struct kmem_cache *cache;
+    int inuse;                  // 已分配出去 (含弹匣中) 的对象数
+};
+
+// 每 CPU 弹匣：关中断后独占访问，分配/释放的常见路径不加锁
+struct kmem_magazine {
+    int count;
+    void *objs[SLAB_MAGAZINE];
+};
+
+struct kmem_cache {
+    struct spinlock lock;       // 保护下面的 slab 链表与统计
+    char name[SLAB_NAME_MAX];
+    uint size;                  // 对齐后的对象大小
+    uint offset;                // 第一个对象相对 slab 首地址的偏移
+    int order;                  // 每个 slab 的页阶
+    int objs_per_slab;
+    void (*ctor)(void *);       // 对象构造函数，仅在 slab 新建时对每个对象调用一次
+
+    struct slab partial;        // 部分空闲的 slab (双向循环链表哨兵)
+    struct slab full;           // 没有空闲对象的 slab
+    struct slab empty;          // 完全空闲的 slab，最多保留一个
+    int nr_empty;
+
+    uint64 nr_slabs;
+    uint64 nr_allocs;
+    uint64 nr_frees;
+
+    struct kmem_magazine mag[NCPU];
+    struct kmem_cache *next;    // 所有缓存组成的链表
+};
+
+void slab_init(void);
+// 对象释放回缓存时必须保持构造后的状态 (例如锁处于未持有)，
+// 再次分配时不会重新调用构造函数
+struct kmem_cache *kmem_cache_create(const char *name, uint size, uint align, void (*ctor)(void *));
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+void kmem_cache_dump(void);
+
+#endif // __SLAB_H__
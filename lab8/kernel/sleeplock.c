@@ -1,36 +1,358 @@
+// kernel/sleeplock.c
+// 自适应睡眠锁。获取分三步：
+//  1. 锁空闲时用一次原子交换直接获得，不拿 lk；
+//  2. 持有者正在另一个 hart 上运行且没有人排队时自旋等待，临界区很短
+//     (如 bio.c 的缓冲区锁、fs.c 的 inode 锁) 时省去一次睡眠与唤醒；
+//  3. 否则挂到等待队列尾部睡眠。释放时若有等待者，锁不经过空闲状态直接
+//     交给队首，后来者不能插队，等待者按到达顺序获得锁。
+//
+// 也可以共享获取 (acquiresleep_shared)：没有写者持有、也没有人排队时，
+// 读者只把 locked 中的读者计数加一。交接给排在队首的读者时，连同紧跟在它
+// 后面的读者一起放行。读者没有 owner，也不参与下面的优先级继承。
+//
+// 优先级继承：排队的进程把持有者的有效 nice 值提升到自己的水平，持有者
+// 自己也在等另一把睡眠锁时沿 blocked_on 继续向下提升 (最多 PI_MAX_DEPTH 层)。
+// 持有者释放锁时按仍持有的锁上的等待者重新计算有效 nice 值。
 #include "defs.h"
 #include "sleeplock.h"
 
+#define SLEEPLOCK_SPIN_MAX 4096     // 自旋检查的次数上限
+#define PI_MAX_DEPTH       8        // 优先级继承沿锁链传递的最大层数
+#define SL_WRITER          0x80000000U  // locked 的最高位表示写者持有，其余位为读者数
+
+// 睡眠等待者，放在等待进程的栈上
+struct sleepwaiter {
+    struct proc *p;
+    struct sleepwaiter *next;
+    int shared;                 // 等待共享获取
+    int granted;                // 释放者已把锁交给它
+};
+
+static int sleeplock_spin = 1;
+static int sleeplock_pi = 1;
+static uint64 nr_spun;          // 自旋等到了锁
+static uint64 nr_slept;         // 排队睡眠后由释放者交接
+static uint64 nr_boosted;       // 提升了持有者优先级的等待次数
+static uint64 nr_contended;     // 锁被占用、需要等待的获取次数
+
 void initsleeplock(struct sleeplock *lk, char *name) {
     spinlock_init(&lk->lk, "sleeplock");
     lk->name = name;
     lk->locked = 0;
     lk->owner = 0;
+    lk->head = lk->tail = 0;
+    lk->held_next = 0;
+#ifdef LOCKSTAT
+    lk->stat = lockstat_class(name, 1);
+#endif
 }
 
-void acquiresleep(struct sleeplock *lk) {
+static int sleeplock_try(struct sleeplock *lk, struct proc *me) {
+    uint expected = 0;
+    if (!__atomic_compare_exchange_n(&lk->locked, &expected, SL_WRITER, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return 0;
+    lk->owner = me;
+    return 1;
+}
+
+// 没有写者、也没有人排队时读者计数加一。有人排队时不插队，写者不会被
+// 源源不断的读者饿死
+static int sleeplock_try_shared(struct sleeplock *lk) {
+    uint v = __atomic_load_n(&lk->locked, __ATOMIC_RELAXED);
+    while (!(v & SL_WRITER) && lk->head == 0) {
+        if (__atomic_compare_exchange_n(&lk->locked, &v, v + 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return 1;
+    }
+    return 0;
+}
+
+static int sleeplock_try_mode(struct sleeplock *lk, struct proc *me, int shared) {
+    return shared ? sleeplock_try_shared(lk) : sleeplock_try(lk, me);
+}
+
+// 写者在运行就继续等。owner 指向的 proc 可能已经退出并被回收，
+// 读到的 state 只用来决定是否继续自旋，读错的代价只是多睡一次或多转几圈
+static int sleeplock_spin_wait(struct sleeplock *lk, struct proc *me, int shared) {
+    for (int i = 0; i < SLEEPLOCK_SPIN_MAX; i++) {
+        uint v = lk->locked;
+        if ((v == 0 || (shared && !(v & SL_WRITER))) && sleeplock_try_mode(lk, me, shared))
+            return 1;
+        if (lk->head)
+            return 0;           // 已经有人排队，不插到它前面
+        if (v & SL_WRITER) {
+            struct proc *o = lk->owner;
+            // o 为 0 说明写者刚拿到锁还没写 owner，继续等
+            if (o && (o == me || o->state != RUNNING))
+                return 0;
+        } else if (!shared) {
+            return 0;           // 被读者持有，不知道它们是否在运行，去排队
+        }
+        asm volatile("nop");
+    }
+    return 0;
+}
+
+// 把 lk 的持有者提升到 nice，返回它正在等待的锁。调用者持有 lk->lk，
+// 持有者在放开 lk 之前不会退出
+static struct sleeplock *pi_boost_owner(struct sleeplock *lk, int nice) {
+    struct proc *o = lk->owner;
+    // o 为 0 时持有者刚拿到锁还没写 owner，它释放时会重新计算，这里放过
+    if (o == 0 || o->nice <= nice)
+        return 0;
+    pi_set_nice(o, nice);
+    return o->blocked_on;
+}
+
+// 沿锁链继续提升。每层只持有当前锁的 lk，链在途中变化时提升的是
+// 新的持有者，它释放锁时会恢复，不会一直保持
+static void pi_boost_chain(struct sleeplock *lk, int nice) {
+    for (int depth = 1; lk && depth < PI_MAX_DEPTH; depth++) {
+        acquire(&lk->lk);
+        struct sleeplock *next = pi_boost_owner(lk, nice);
+        release(&lk->lk);
+        lk = next;
+    }
+}
+
+// lk 上等待者中最高的优先级 (最小的 nice)，调用者持有 lk->lk
+static int pi_waiters_nice(struct sleeplock *lk, int nice) {
+    for (struct sleepwaiter *w = lk->head; w; w = w->next) {
+        if (w->p->nice < nice)
+            nice = w->p->nice;
+    }
+    return nice;
+}
+
+// 当前进程放开了一把锁，按仍持有的锁上的等待者重新计算有效 nice 值。
+// 计算和设置期间一直持有这些锁的 lk，新来的等待者的提升不会被覆盖。
+// 只有锁的持有者会同时拿多把锁的 lk，不会死锁
+static void pi_restore(struct proc *me) {
+    int nice = me->nice_base;
+    for (struct sleeplock *l = me->held_locks; l; l = l->held_next) {
+        acquire(&l->lk);
+        nice = pi_waiters_nice(l, nice);
+    }
+    pi_set_nice(me, nice);
+    for (struct sleeplock *l = me->held_locks; l; l = l->held_next)
+        release(&l->lk);
+}
+
+static void sleeplock_wait(struct sleeplock *lk, struct proc *me, int shared) {
     acquire(&lk->lk);
-    while (lk->locked) {
-        sleep(lk, &lk->lk);
+    // 释放者在 lk 下把 locked 清零或交接，这里再试一次不会错过
+    if (sleeplock_try_mode(lk, me, shared)) {
+        release(&lk->lk);
+        return;
+    }
+    struct sleepwaiter w = { me, 0, shared, 0 };
+    if (lk->tail)
+        lk->tail->next = &w;
+    else
+        lk->head = &w;
+    lk->tail = &w;
+    me->blocked_on = lk;
+
+    if (sleeplock_pi && lk->owner && lk->owner->nice > me->nice) {
+        __atomic_fetch_add(&nr_boosted, 1, __ATOMIC_RELAXED);
+        struct sleeplock *next = pi_boost_owner(lk, me->nice);
+        if (next) {
+            // 放开 lk 再沿链提升；期间被交接的话 granted 已置位，不会睡下去
+            release(&lk->lk);
+            pi_boost_chain(next, me->nice);
+            acquire(&lk->lk);
+        }
     }
-    lk->locked = 1;
-    lk->owner = myproc();
+
+    while (!w.granted)
+        sleep(&w, &lk->lk);
     release(&lk->lk);
+    __atomic_fetch_add(&nr_slept, 1, __ATOMIC_RELAXED);
+}
+
+// 锁被占用时先自旋、再排队睡眠，返回是否遇到了竞争
+static int sleeplock_lock(struct sleeplock *lk, struct proc *me, int shared) {
+    if (sleeplock_try_mode(lk, me, shared))
+        return 0;
+    __atomic_fetch_add(&nr_contended, 1, __ATOMIC_RELAXED);
+    if (sleeplock_spin && sleeplock_spin_wait(lk, me, shared))
+        __atomic_fetch_add(&nr_spun, 1, __ATOMIC_RELAXED);
+    else
+        sleeplock_wait(lk, me, shared);
+    return 1;
+}
+
+// 放行排在队首的连续读者，返回放行的个数，调用者持有 lk->lk
+static uint sleeplock_grant_readers(struct sleeplock *lk) {
+    struct sleepwaiter *w = lk->head;
+    uint n = 0;
+    while (w && w->shared) {
+        struct sleepwaiter *next = w->next;
+        w->p->blocked_on = 0;
+        w->granted = 1;
+        wakeup(w);
+        n++;
+        w = next;
+    }
+    lk->head = w;
+    if (w == 0)
+        lk->tail = 0;
+    return n;
+}
+
+// 锁空出来时交给队首：写者单独获得，读者连同紧跟其后的读者一起获得。
+// 返回新的 locked 值，调用者持有 lk->lk 且 lk->head 不为空
+static uint sleeplock_grant(struct sleeplock *lk) {
+    struct sleepwaiter *w = lk->head;
+    if (!w->shared) {
+        lk->head = w->next;
+        lk->owner = w->p;
+        w->p->blocked_on = 0;
+        w->granted = 1;
+        // 新的持有者继承仍在排队的等待者的优先级
+        int nice = pi_waiters_nice(lk, w->p->nice);
+        if (sleeplock_pi && nice < w->p->nice)
+            pi_set_nice(w->p, nice);
+        wakeup(w);
+        if (lk->head == 0)
+            lk->tail = 0;
+        return SL_WRITER;
+    }
+    lk->owner = 0;
+    return sleeplock_grant_readers(lk);
+}
+
+static void held_remove(struct proc *me, struct sleeplock *lk) {
+    struct sleeplock **pp = &me->held_locks;
+    while (*pp && *pp != lk)
+        pp = &(*pp)->held_next;
+    if (*pp)
+        *pp = lk->held_next;
+}
+
+void acquiresleep(struct sleeplock *lk) {
+    struct proc *me = myproc();
+#ifdef LOCKSTAT
+    uint64 start = r_time();
+#endif
+    int contended = sleeplock_lock(lk, me, 0);
+    if (me) {
+        lk->held_next = me->held_locks;
+        me->held_locks = lk;
+    }
+#ifdef LOCKSTAT
+    uint64 now = r_time();
+    lockstat_acquired(lk->stat, (uint64)__builtin_return_address(0), contended, now - start);
+    lk->stat_acquired = now;
+#else
+    (void)contended;
+#endif
 }
 
 void releasesleep(struct sleeplock *lk) {
+    struct proc *me = myproc();
+    if (me)
+        held_remove(me, lk);
+
     acquire(&lk->lk);
-    lk->locked = 0;
-    lk->owner = 0;
-    wakeup(lk);
+#ifdef LOCKSTAT
+    lockstat_released(lk->stat, r_time() - lk->stat_acquired);
+#endif
+    if (lk->head) {
+        // 直接交接：locked 不经过 0，自旋者和新来者都拿不到
+        __atomic_store_n(&lk->locked, sleeplock_grant(lk), __ATOMIC_RELEASE);
+    } else {
+        lk->owner = 0;
+        __atomic_store_n(&lk->locked, 0, __ATOMIC_RELEASE);
+    }
     release(&lk->lk);
+
+    if (me && me->nice < me->nice_base)
+        pi_restore(me);
 }
 
-int holdingsleep(struct sleeplock *lk) {
-    int r;
+// 共享获取。读者的持有时间不计入 lockstat
+void acquiresleep_shared(struct sleeplock *lk) {
+#ifdef LOCKSTAT
+    uint64 start = r_time();
+    int contended = sleeplock_lock(lk, myproc(), 1);
+    lockstat_acquired(lk->stat, (uint64)__builtin_return_address(0), contended, r_time() - start);
+#else
+    sleeplock_lock(lk, myproc(), 1);
+#endif
+}
+
+// 不是最后一个读者时只把计数减一；最后一个读者在 lk 下减到 0 或交接，
+// 与在 lk 下检查 locked 后排队的写者不会错过
+void releasesleep_shared(struct sleeplock *lk) {
+    uint v = __atomic_load_n(&lk->locked, __ATOMIC_RELAXED);
+    if (v == 0 || (v & SL_WRITER))
+        panic("releasesleep_shared");
+    while (v > 1) {
+        if (__atomic_compare_exchange_n(&lk->locked, &v, v - 1, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+    }
 
     acquire(&lk->lk);
-    r = lk->locked && lk->owner == myproc();
+    // 持有 lk 时队列不变，只有无锁的读者可能同时把计数加一
+    int handoff;
+    v = __atomic_load_n(&lk->locked, __ATOMIC_RELAXED);
+    do {
+        handoff = v == 1 && lk->head != 0;
+        // 交接时先写入 SL_WRITER 挡住无锁的读者，再写入交接后的值
+    } while (!__atomic_compare_exchange_n(&lk->locked, &v, handoff ? SL_WRITER : v - 1, 0,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (handoff)
+        __atomic_store_n(&lk->locked, sleeplock_grant(lk), __ATOMIC_RELEASE);
     release(&lk->lk);
-    return r;
+}
+
+// 写者降级为读者，同时放行排在队首的读者。用于独占地加载数据之后共享地读取
+void downgradesleep(struct sleeplock *lk) {
+    struct proc *me = myproc();
+    if (me)
+        held_remove(me, lk);
+
+    acquire(&lk->lk);
+#ifdef LOCKSTAT
+    lockstat_released(lk->stat, r_time() - lk->stat_acquired);
+#endif
+    lk->owner = 0;
+    __atomic_store_n(&lk->locked, 1 + sleeplock_grant_readers(lk), __ATOMIC_RELEASE);
+    release(&lk->lk);
+
+    if (me && me->nice < me->nice_base)
+        pi_restore(me);
+}
+
+// owner 只有持有者自己 (释放时) 会把它从自己改掉，所以不需要拿 lk
+int holdingsleep(struct sleeplock *lk) {
+    return (lk->locked & SL_WRITER) && lk->owner == myproc();
+}
+
+// 打开或关闭自旋阶段，返回原来的设置
+int sleeplock_set_spin(int on) {
+    int old = sleeplock_spin;
+    sleeplock_spin = on;
+    return old;
+}
+
+// 打开或关闭优先级继承，返回原来的设置
+int sleeplock_set_pi(int on) {
+    int old = sleeplock_pi;
+    sleeplock_pi = on;
+    return old;
+}
+
+uint64 sleeplock_boosted_waits(void) {
+    return nr_boosted;
+}
+
+void sleeplock_dump_stats(void) {
+    printf("=== Sleeplock ===\n");
+    printf("  spin=%s pi=%s contended=%lu spun=%lu slept=%lu boosted=%lu\n",
+           sleeplock_spin ? "on" : "off", sleeplock_pi ? "on" : "off",
+           nr_contended, nr_spun, nr_slept, nr_boosted);
 }
@@ -4,17 +4,30 @@
 #include "spinlock.h"
 
 struct proc;
+struct sleepwaiter;
 
+// 自适应读写睡眠锁：持有者正在另一个 hart 上运行时先自旋等待，
+// 否则按到达顺序排队睡眠，释放时直接把锁交给队首的等待者
 struct sleeplock {
-    uint locked;       // 是否持有
-    struct spinlock lk;// 自旋锁保护 sleeplock
+    volatile uint locked;       // 最高位为写者持有，其余位为读者数；无等待者时可以不拿 lk 直接获取
+    struct spinlock lk;         // 保护等待队列
     char *name;
-    struct proc *owner;
+    struct proc *volatile owner;
+    struct sleepwaiter *head;   // 睡眠等待者的 FIFO 队列
+    struct sleepwaiter *tail;
+    struct sleeplock *held_next;    // 持有者的 held_locks 链表
+#ifdef LOCKSTAT
+    struct lockstat *stat;
+    uint64 stat_acquired;   // 获得锁时的 time CSR，释放时可能已换到别的 hart
+#endif
 };
 
 void initsleeplock(struct sleeplock *lk, char *name);
 void acquiresleep(struct sleeplock *lk);
 void releasesleep(struct sleeplock *lk);
+void acquiresleep_shared(struct sleeplock *lk);
+void releasesleep_shared(struct sleeplock *lk);
+void downgradesleep(struct sleeplock *lk);
 int holdingsleep(struct sleeplock *lk);
 
 #endif // __SLEEPLOCK_H__
@@ -1,10 +1,121 @@
 // kernel/spinlock.c
 #include "defs.h"
 
-void spinlock_init(struct spinlock *lk, char *name) {
+#define BACKOFF_MIN  4
+#define BACKOFF_MAX  1024
+#define MCS_NODES    8          // 每个 CPU 同时持有的 MCS 锁上限
+
+// 每个 CPU 一组 MCS 节点，获取锁时分配、释放时归还。锁不一定按嵌套顺序释放
+// (如 sleep() 先拿 p->lock 再放开条件锁)，所以用位图而不是栈
+static struct mcs_node mcs_nodes[NCPU][MCS_NODES];
+static uint32 mcs_used[NCPU];
+
+static inline void cpu_relax(int n) {
+    for (int i = 0; i < n; i++) {
+        asm volatile("nop");
+    }
+}
+
+static struct mcs_node *mcs_node_get(void) {
+    int cpu = cpuid();
+    for (int i = 0; i < MCS_NODES; i++) {
+        if (!(mcs_used[cpu] & (1U << i))) {
+            __atomic_fetch_or(&mcs_used[cpu], 1U << i, __ATOMIC_RELAXED);
+            struct mcs_node *n = &mcs_nodes[cpu][i];
+            n->next = 0;
+            n->wait = 1;
+            return n;
+        }
+    }
+    panic("acquire: too many MCS locks held");
+    return 0;
+}
+
+static void mcs_node_put(struct mcs_node *n) {
+    int idx = n - &mcs_nodes[0][0];
+    __atomic_fetch_and(&mcs_used[idx / MCS_NODES], ~(1U << (idx % MCS_NODES)), __ATOMIC_RELAXED);
+}
+
+void spinlock_init_type(struct spinlock *lk, char *name, int type) {
     lk->name = name;
     lk->locked = 0;
     lk->cpu = 0;
+    lk->type = type;
+    lk->ticket_next = 0;
+    lk->ticket_owner = 0;
+    lk->mcs_tail = 0;
+    lk->mcs_owner = 0;
+#ifdef LOCKSTAT
+    lk->stat = lockstat_class(name, 0);
+#endif
+}
+
+void spinlock_init(struct spinlock *lk, char *name) {
+    spinlock_init_type(lk, name, SPIN_TAS);
+}
+
+// 先只读地等锁空闲再尝试交换，失败后等待的时间加倍，减少对锁所在缓存行的争抢。
+// 三种实现都返回是否遇到了竞争
+static int tas_lock(struct spinlock *lk) {
+    int backoff = BACKOFF_MIN;
+    int contended = 0;
+    while (__atomic_test_and_set(&lk->locked, __ATOMIC_ACQUIRE)) {
+        contended = 1;
+        do {
+            cpu_relax(backoff);
+            if (backoff < BACKOFF_MAX)
+                backoff <<= 1;
+        } while (__atomic_load_n(&lk->locked, __ATOMIC_RELAXED));
+    }
+    return contended;
+}
+
+// 等待时间与前面排队的人数成正比，轮到之前不去读 ticket_owner
+static int ticket_lock(struct spinlock *lk) {
+    uint32 me = __atomic_fetch_add(&lk->ticket_next, 1, __ATOMIC_RELAXED);
+    int contended = 0;
+    for (;;) {
+        uint32 owner = __atomic_load_n(&lk->ticket_owner, __ATOMIC_ACQUIRE);
+        if (owner == me)
+            break;
+        contended = 1;
+        uint32 ahead = me - owner;
+        cpu_relax(ahead * BACKOFF_MIN < BACKOFF_MAX ? ahead * BACKOFF_MIN : BACKOFF_MAX);
+    }
+    lk->locked = 1;
+    return contended;
+}
+
+// 挂到队尾，在自己的节点上等前驱交接
+static int mcs_lock(struct spinlock *lk) {
+    struct mcs_node *n = mcs_node_get();
+    struct mcs_node *prev = __atomic_exchange_n(&lk->mcs_tail, n, __ATOMIC_ACQ_REL);
+    if (prev) {
+        __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&n->wait, __ATOMIC_ACQUIRE))
+            cpu_relax(BACKOFF_MIN);
+    }
+    lk->mcs_owner = n;
+    lk->locked = 1;
+    return prev != 0;
+}
+
+static void mcs_unlock(struct spinlock *lk) {
+    struct mcs_node *n = lk->mcs_owner;
+    struct mcs_node *next = __atomic_load_n(&n->next, __ATOMIC_ACQUIRE);
+    if (next == 0) {
+        struct mcs_node *expected = n;
+        if (__atomic_compare_exchange_n(&lk->mcs_tail, &expected, 0, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            mcs_node_put(n);
+            return;
+        }
+        // 后继已经换掉了队尾，等它把自己挂到 n->next 上
+        while ((next = __atomic_load_n(&n->next, __ATOMIC_ACQUIRE)) == 0)
+            cpu_relax(BACKOFF_MIN);
+    }
+    __atomic_store_n(&next->wait, 0, __ATOMIC_RELEASE);
+    mcs_node_put(n);
 }
 
 // 获取锁
@@ -16,11 +127,59 @@ void acquire(struct spinlock *lk) {
         while(1);
     }
 
-    // 使用 RISC-V 的 'amst' (atomic swap) 指令
-    while (__atomic_test_and_set(&lk->locked, __ATOMIC_ACQUIRE));
+#ifdef LOCKSTAT
+    uint64 start = r_cycle();
+#endif
+    int contended;
+    if (lk->type == SPIN_TICKET)
+        contended = ticket_lock(lk);
+    else if (lk->type == SPIN_MCS)
+        contended = mcs_lock(lk);
+    else
+        contended = tas_lock(lk);
 
     // 记录持有锁的CPU，用于调试
     lk->cpu = mycpu();
+#ifdef LOCKSTAT
+    uint64 now = r_cycle();
+    lockstat_acquired(lk->stat, (uint64)__builtin_return_address(0), contended, now - start);
+    lk->stat_acquired = now;
+#else
+    (void)contended;
+#endif
+}
+
+// 尝试获取锁，锁已被持有时不等待，返回 0
+int tryacquire(struct spinlock *lk) {
+    push_off();
+    int ok;
+    if (lk->type == SPIN_TICKET) {
+        uint32 owner = __atomic_load_n(&lk->ticket_owner, __ATOMIC_RELAXED);
+        ok = __atomic_compare_exchange_n(&lk->ticket_next, &owner, owner + 1, 0,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    } else if (lk->type == SPIN_MCS) {
+        struct mcs_node *n = mcs_node_get();
+        struct mcs_node *expected = 0;
+        ok = __atomic_compare_exchange_n(&lk->mcs_tail, &expected, n, 0,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+        if (ok)
+            lk->mcs_owner = n;
+        else
+            mcs_node_put(n);
+    } else {
+        ok = !__atomic_test_and_set(&lk->locked, __ATOMIC_ACQUIRE);
+    }
+    if (!ok) {
+        pop_off();
+        return 0;
+    }
+    lk->locked = 1;
+    lk->cpu = mycpu();
+#ifdef LOCKSTAT
+    lockstat_acquired(lk->stat, (uint64)__builtin_return_address(0), 0, 0);
+    lk->stat_acquired = r_cycle();
+#endif
+    return 1;
 }
 
 // 释放锁
@@ -30,8 +189,19 @@ void release(struct spinlock *lk) {
         while(1);
     }
 
+#ifdef LOCKSTAT
+    lockstat_released(lk->stat, r_cycle() - lk->stat_acquired);
+#endif
     lk->cpu = 0;
-    __atomic_clear(&lk->locked, __ATOMIC_RELEASE);
+    if (lk->type == SPIN_TICKET) {
+        lk->locked = 0;
+        __atomic_store_n(&lk->ticket_owner, lk->ticket_owner + 1, __ATOMIC_RELEASE);
+    } else if (lk->type == SPIN_MCS) {
+        lk->locked = 0;
+        mcs_unlock(lk);
+    } else {
+        __atomic_clear(&lk->locked, __ATOMIC_RELEASE);
+    }
     pop_off(); // 恢复之前的中断状态
 }
 
@@ -4,14 +4,37 @@
 
 #include "riscv.h" // 包含它以获取 uint64 的定义
 
+// 自旋锁的实现方式，每把锁初始化时选定：
+//  SPIN_TAS    test-and-set，竞争时指数退避；不公平，但无竞争时最便宜
+//  SPIN_TICKET 排号锁，按到达顺序获得；所有等待者仍读同一个缓存行
+//  SPIN_MCS    排队锁，每个等待者在自己的节点上自旋，竞争激烈时没有缓存行风暴
+enum spintype { SPIN_TAS, SPIN_TICKET, SPIN_MCS };
+
+struct lockstat;
+
+struct mcs_node {
+    struct mcs_node *volatile next;
+    volatile int wait;
+};
+
 // 自旋锁
 struct spinlock {
-    uint64 locked;
+    uint64 locked;              // 是否被持有 (三种实现都维护，用于检查)
     char *name;
     struct cpu *cpu;
+    int type;                   // enum spintype
+    volatile uint32 ticket_next;    // SPIN_TICKET：下一个号
+    volatile uint32 ticket_owner;   // SPIN_TICKET：正在服务的号
+    struct mcs_node *volatile mcs_tail; // SPIN_MCS：队尾
+    struct mcs_node *mcs_owner;     // SPIN_MCS：持有者的节点
+#ifdef LOCKSTAT
+    struct lockstat *stat;      // 同名锁共用的统计
+    uint64 stat_acquired;       // 获得锁时的 cycle 计数
+#endif
 };
 
 void spinlock_init(struct spinlock *lk, char *name);
+void spinlock_init_type(struct spinlock *lk, char *name, int type);
 void acquire(struct spinlock *lk);
 void release(struct spinlock *lk);
 
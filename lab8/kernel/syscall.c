@@ -19,6 +19,16 @@ extern uint64 sys_mknod(void);
 extern uint64 sys_chdir(void);
 extern uint64 sys_fstat(void);
 extern uint64 sys_klog(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_setgroup(void);
+extern uint64 sys_groupweight(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_setdeadline(void);
+extern uint64 sys_dl_yield(void);
+extern uint64 sys_sleep(void);
+extern uint64 sys_uptime(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_lockstat(void);
 
 static uint64 (*syscalls[32])(void) = {
     [SYS_fork]    sys_fork,
@@ -38,6 +48,16 @@ static uint64 (*syscalls[32])(void) = {
     [SYS_chdir]   sys_chdir,
     [SYS_fstat]   sys_fstat,
     [SYS_klog]    sys_klog,
+    [SYS_setpriority] sys_setpriority,
+    [SYS_setgroup] sys_setgroup,
+    [SYS_groupweight] sys_groupweight,
+    [SYS_setaffinity] sys_setaffinity,
+    [SYS_setdeadline] sys_setdeadline,
+    [SYS_dl_yield] sys_dl_yield,
+    [SYS_sleep]   sys_sleep,
+    [SYS_uptime]  sys_uptime,
+    [SYS_nanosleep] sys_nanosleep,
+    [SYS_lockstat] sys_lockstat,
 };
 
 int argint(int n, int *ip) {
@@ -24,5 +24,13 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_klog   22
+#define SYS_setpriority 23
+#define SYS_setgroup 24
+#define SYS_groupweight 25
+#define SYS_setaffinity 26
+#define SYS_setdeadline 27
+#define SYS_dl_yield 28
+#define SYS_nanosleep 29
+#define SYS_lockstat 30
 
 #endif
\ No newline at end of file
@@ -44,4 +44,100 @@ uint64 sys_klog(void) {
         return -1;
 
     return klog_read(buf, len);
-}
\ No newline at end of file
+}
+// sys_setpriority(int pid, int nice)
+// 设置进程的 nice 值，pid 为 0 表示调用者自己
+uint64 sys_setpriority(void) {
+    int pid, nice;
+    if (argint(0, &pid) < 0 || argint(1, &nice) < 0)
+        return -1;
+    return setpriority(pid, nice);
+}
+
+// sys_setgroup(int pid, int gid)
+// 把进程移到 CFS 调度组 gid
+uint64 sys_setgroup(void) {
+    int pid, gid;
+    if (argint(0, &pid) < 0 || argint(1, &gid) < 0)
+        return -1;
+    return setgroup(pid, gid);
+}
+
+// sys_groupweight(int gid, int weight)
+// 设置调度组的权重，nice 0 进程的权重为 1024
+uint64 sys_groupweight(void) {
+    int gid, weight;
+    if (argint(0, &gid) < 0 || argint(1, &weight) < 0)
+        return -1;
+    return sched_group_set_weight(gid, weight);
+}
+
+// sys_setaffinity(int pid, int cpu)
+// 把进程绑定到一个 CPU 上，cpu 为 -1 时解除绑定
+uint64 sys_setaffinity(void) {
+    int pid, cpu;
+    if (argint(0, &pid) < 0 || argint(1, &cpu) < 0)
+        return -1;
+    return setaffinity(pid, cpu);
+}
+
+// sys_setdeadline(int runtime, int deadline, int period)
+// 把调用者设为 EDF 周期实时任务，参数单位为节拍；runtime 为 0 时恢复为普通进程。
+// 利用率超出准入上限时返回 -1
+uint64 sys_setdeadline(void) {
+    int runtime, deadline, period;
+    if (argint(0, &runtime) < 0 || argint(1, &deadline) < 0 || argint(2, &period) < 0)
+        return -1;
+    return sched_setdeadline(runtime, deadline, period);
+}
+
+// sys_dl_yield(void)
+// 实时任务完成本周期的作业，睡眠到下一个周期开始
+uint64 sys_dl_yield(void) {
+    return sched_dl_yield();
+}
+
+// sys_sleep(int n)
+// 睡眠 n 个时钟节拍，由时间轮在到期时唤醒一次
+uint64 sys_sleep(void) {
+    int n;
+    if (argint(0, &n) < 0 || n < 0)
+        return -1;
+    sleep_ticks(n);
+    return 0;
+}
+
+// sys_uptime(void)
+// 返回启动以来的时钟节拍数
+uint64 sys_uptime(void) {
+    return get_ticks();
+}
+
+// sys_nanosleep(uint64 ns)
+// 睡眠 ns 纳秒，由高精度定时器唤醒，不受节拍粒度限制
+uint64 sys_nanosleep(void) {
+    uint64 ns;
+    if (argaddr(0, &ns) < 0)
+        return -1;
+    sleep_ns(ns);
+    return 0;
+}
+
+// sys_lockstat(int op)
+// op 为 0 时打印锁统计，为 1 时清零。未以 LOCKSTAT=1 编译时返回 -1
+uint64 sys_lockstat(void) {
+    int op;
+    if (argint(0, &op) < 0)
+        return -1;
+#ifdef LOCKSTAT
+    if (op == 0) {
+        lockstat_dump();
+        return 0;
+    }
+    if (op == 1) {
+        lockstat_reset();
+        return 0;
+    }
+#endif
+    return -1;
+}
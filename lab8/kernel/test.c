@@ -10,7 +10,6 @@
 
 #define NULL ((void*)0)
 
-extern struct proc proc[NPROC];
 extern uint64 get_time(void);
 
 void assert(int condition) {
@@ -23,9 +22,6 @@ void assert(int condition) {
 static struct proc* find_current_process_hard() {
     struct proc *p = myproc();
     if (p && p->state == RUNNING) return p;
-    for(int i = 0; i < NPROC; i++) {
-        if (proc[i].state == RUNNING) return &proc[i];
-    }
     return NULL;
 }
 
@@ -62,6 +58,16 @@ int stub_link(const char *old, const char *newp) { return do_syscall(SYS_link, (
 int stub_mknod(const char *path, int major, int minor) { return do_syscall(SYS_mknod, (uint64)path, major, minor); }
 int stub_fstat(int fd, struct stat *st) { return do_syscall(SYS_fstat, fd, (uint64)st, 0); }
 int stub_klog(char *buf, int len) { return do_syscall(SYS_klog, (uint64)buf, len, 0); }
+int stub_setpriority(int pid, int nice) { return do_syscall(SYS_setpriority, pid, nice, 0); }
+int stub_setgroup(int pid, int gid) { return do_syscall(SYS_setgroup, pid, gid, 0); }
+int stub_groupweight(int gid, int weight) { return do_syscall(SYS_groupweight, gid, weight, 0); }
+int stub_setaffinity(int pid, int cpu) { return do_syscall(SYS_setaffinity, pid, cpu, 0); }
+int stub_setdeadline(int runtime, int deadline, int period) { return do_syscall(SYS_setdeadline, runtime, deadline, period); }
+int stub_dl_yield(void) { return do_syscall(SYS_dl_yield, 0, 0, 0); }
+int stub_sleep(int n) { return do_syscall(SYS_sleep, n, 0, 0); }
+int stub_uptime(void) { return do_syscall(SYS_uptime, 0, 0, 0); }
+int stub_nanosleep(uint64 ns) { return do_syscall(SYS_nanosleep, ns, 0, 0); }
+int stub_lockstat(int op) { return do_syscall(SYS_lockstat, op, 0, 0); }
 
 static void build_name(char *buf, const char *prefix, int idx) {
     int i = 0;
@@ -99,6 +105,29 @@ static void test_klog_overflow(void);
 static void test_klog_formatting(void);
 static void test_klog_syscall_stream(void);
 static void reset_klog_defaults(void);
+static void test_kalloc_scaling(void);
+static void test_buddy_allocator(void);
+static void test_slab_caches(void);
+static void test_zeroed_pool(void);
+static void test_megapage_tlb(void);
+static void test_smp_parallel(void);
+static void test_runq_scaling(void);
+static void test_preemption(void);
+static void test_mlfq(void);
+static void test_cfs_shares(void);
+static void test_edf_deadlines(void);
+static void test_wait_queues(void);
+static void test_timer_wheel(void);
+static void test_tickless(void);
+void test_interrupt_overhead(void);
+static void test_idle(void);
+static void test_direct_switch(void);
+static void test_spinlock_types(void);
+static void test_lockstat(void);
+static void test_adaptive_mutex(void);
+static void test_priority_inheritance(void);
+static void test_shared_inode_lock(void);
+static void test_fork_exit_wait(void);
 
 void test_basic_syscalls(void) {
     printf("\n=== Test 10: Basic System Calls ===\n");
@@ -209,6 +238,34 @@ void run_lab8_tests(void) {
     printf("===== Lab8 Kernel Logging Tests Completed =====\n");
 }
 
+void run_perf_tests(void) {
+    printf("\n===== Starting Kernel Performance Tests =====\n");
+    test_kalloc_scaling();
+    test_buddy_allocator();
+    test_slab_caches();
+    test_zeroed_pool();
+    test_megapage_tlb();
+    test_smp_parallel();
+    test_runq_scaling();
+    test_preemption();
+    test_mlfq();
+    test_cfs_shares();
+    test_edf_deadlines();
+    test_wait_queues();
+    test_timer_wheel();
+    test_tickless();
+    test_interrupt_overhead();
+    test_idle();
+    test_direct_switch();
+    test_spinlock_types();
+    test_lockstat();
+    test_adaptive_mutex();
+    test_priority_inheritance();
+    test_shared_inode_lock();
+    test_fork_exit_wait();
+    printf("===== Kernel Performance Tests Completed =====\n");
+}
+
 // === 增强调试信息的完整性测试 ===
 static void test_filesystem_integrity(void) {
     printf("\n=== FS Test 1: Integrity ===\n");
@@ -582,13 +639,1723 @@ static void reset_klog_defaults(void) {
     klog_set_console_level(KLOG_LEVEL_WARN);
 }
 
+// 等后台清零线程停下来 (池不再变化)，之后 kfreemem() 的结果才稳定
+static void wait_zpool_idle(void) {
+    int last = -1;
+    while (kalloc_zpool_count() != last) {
+        last = kalloc_zpool_count();
+        uint64 start = get_ticks();
+        while (get_ticks() - start < 2)
+            yield();
+    }
+}
+
+// 页分配风暴：每个 worker 反复分配一批页再全部释放
+#define KSTORM_ROUNDS 500
+#define KSTORM_BURST  16
+
+static void kalloc_storm(void) {
+    void *pages[KSTORM_BURST];
+    for (int r = 0; r < KSTORM_ROUNDS; r++) {
+        for (int i = 0; i < KSTORM_BURST; i++) {
+            pages[i] = kalloc();
+        }
+        for (int i = 0; i < KSTORM_BURST; i++) {
+            if (pages[i]) kfree(pages[i]);
+        }
+    }
+}
+
+static void test_kalloc_scaling(void) {
+    printf("\n=== Perf Test 1: kalloc/kfree Storm (每 CPU 页缓存) ===\n");
+    wait_zpool_idle();
+    uint64 free_before = kfreemem();
+
+    for (int workers = 1; workers <= machine.ncpu; workers++) {
+        uint64 start = get_time();
+        for (int i = 0; i < workers; i++) {
+            int pid = stub_fork();
+            if (pid == 0) {
+                kalloc_storm();
+                stub_exit(0);
+            }
+        }
+        for (int i = 0; i < workers; i++) {
+            int status = 0;
+            stub_wait(&status);
+        }
+        uint64 elapsed = get_time() - start;
+        uint64 pages = (uint64)workers * KSTORM_ROUNDS * KSTORM_BURST;
+        if (elapsed == 0) elapsed = 1;
+        printf("  %d hart(s): %lu pages alloc+free in %lu ticks, %lu pages/sec\n",
+               workers, pages, elapsed, pages * machine.timebase / elapsed);
+    }
+
+    // kalloc() 会触发后台清零线程，等它停下来再比较
+    wait_zpool_idle();
+    kalloc_dump_stats();
+    uint64 free_after = kfreemem();
+    printf("  free pages before=%lu after=%lu\n", free_before, free_after);
+    assert(free_after == free_before);
+    printf("kalloc storm test passed\n");
+}
+
+static void test_buddy_allocator(void) {
+    printf("\n=== Perf Test 2: Buddy Allocator (连续多页分配与合并) ===\n");
+    uint64 before[MAX_ORDER];
+    void *blocks[12];
+    int orders[12];
+
+    // 先按相同模式分配释放一轮，让所需的块都已从未触及的内存中切出，
+    // 之后各阶空闲块数的变化只来自分配与合并本身
+    for (int i = 0; i < 12; i++) {
+        blocks[i] = kalloc_pages(1 + i % 6);
+    }
+    for (int i = 0; i < 12; i++) {
+        kfree_pages(blocks[i], 1 + i % 6);
+    }
+    for (int o = 0; o < MAX_ORDER; o++) {
+        before[o] = kalloc_free_blocks(o);
+    }
+    uint64 free_before = kfreemem();
+
+    // 交错分配不同阶的块，检查对齐与互不重叠
+    for (int i = 0; i < 12; i++) {
+        orders[i] = 1 + i % 6;
+        blocks[i] = kalloc_pages(orders[i]);
+        assert(blocks[i] != 0);
+        assert(((uint64)blocks[i] % ((uint64)PGSIZE << orders[i])) == 0);
+        *(uint64*)blocks[i] = i;
+    }
+    for (int i = 0; i < 12; i++) {
+        assert(*(uint64*)blocks[i] == i);
+    }
+    printf("  allocated 12 blocks of order 1..6, all naturally aligned\n");
+    kalloc_dump_buddy();
+
+    // 以与分配不同的顺序释放，伙伴合并后各阶空闲块数应恢复原状
+    for (int i = 11; i >= 0; i -= 2) {
+        kfree_pages(blocks[i], orders[i]);
+    }
+    for (int i = 0; i < 12; i += 2) {
+        kfree_pages(blocks[i], orders[i]);
+    }
+    for (int o = 0; o < MAX_ORDER; o++) {
+        assert(kalloc_free_blocks(o) == before[o]);
+    }
+    assert(kfreemem() == free_before);
+
+    // 一个 2MB 的块足以作为大页使用
+    void *mega = kalloc_pages(9);
+    assert(mega != 0 && ((uint64)mega % (2L << 20)) == 0);
+    kfree_pages(mega, 9);
+    printf("Buddy allocator test passed\n");
+}
+
+struct slab_test_obj {
+    uint64 magic;
+    int ctor_runs;
+    char payload[100];
+};
+
+static void slab_test_ctor(void *obj) {
+    struct slab_test_obj *o = obj;
+    o->magic = 0x5AB5AB;
+    o->ctor_runs++;
+}
+
+static volatile int slab_test_release;
+
+static void test_slab_caches(void) {
+    printf("\n=== Perf Test 3: Slab Object Caches ===\n");
+
+    // 1. 构造函数只在 slab 新建时运行一次，对象回收后保持构造状态
+    struct kmem_cache *c = kmem_cache_create("slab_test", sizeof(struct slab_test_obj), 0, slab_test_ctor);
+    struct slab_test_obj *objs[40];
+    for (int i = 0; i < 40; i++) {
+        objs[i] = kmem_cache_alloc(c);
+        assert(objs[i] != 0);
+        assert(objs[i]->magic == 0x5AB5AB && objs[i]->ctor_runs == 1);
+    }
+    for (int i = 0; i < 40; i++) {
+        kmem_cache_free(c, objs[i]);
+    }
+    struct slab_test_obj *again = kmem_cache_alloc(c);
+    assert(again == objs[39] && again->ctor_runs == 1);
+    kmem_cache_free(c, again);
+    printf("  %d objects per %d KB slab, constructor ran once per object\n",
+           c->objs_per_slab, (PGSIZE << c->order) / 1024);
+
+    // 2. 进程数不再受固定表长限制 (原 NPROC = 64)
+    const int nchild = 80;
+    int created = 0;
+    slab_test_release = 0;
+    for (int i = 0; i < nchild; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            while (!slab_test_release)
+                yield();
+            stub_exit(0);
+        }
+        if (pid > 0)
+            created++;
+    }
+    printf("  %d processes alive at once (ptable.count=%d)\n", created + 1, ptable.count);
+    assert(created == nchild);
+    slab_test_release = 1;
+    for (int i = 0; i < created; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+
+    kmem_cache_dump();
+    printf("Slab cache test passed\n");
+}
+
+#define ZTEST_PAGES 32
+
+// 等待后台清零线程把池补充到至少 n 页
+static void wait_zpool(int n) {
+    uint64 start = get_ticks();
+    while (kalloc_zpool_count() < n && get_ticks() - start < 100)
+        yield();
+}
+
+static void test_zeroed_pool(void) {
+    printf("\n=== Perf Test 4: Pre-zeroed Page Pool ===\n");
+    void *pages[ZTEST_PAGES];
+    wait_zpool_idle();
+    uint64 free_before = kfreemem();
+
+    wait_zpool(ZTEST_PAGES);
+    assert(kalloc_zpool_count() >= ZTEST_PAGES);
+
+    // 1. 从池中取页：无需现场清零，且内容必须全零
+    uint64 start = get_time();
+    for (int i = 0; i < ZTEST_PAGES; i++) {
+        pages[i] = kalloc_zeroed();
+    }
+    uint64 pool_time = get_time() - start;
+    for (int i = 0; i < ZTEST_PAGES; i++) {
+        assert(pages[i] != 0);
+        uint64 *w = pages[i];
+        for (int j = 0; j < PGSIZE / sizeof(uint64); j++) {
+            assert(w[j] == 0);
+        }
+        kfree(pages[i]);
+    }
+
+    // 2. 对照：不清零的分配 + 原先的逐字节清零
+    start = get_time();
+    for (int i = 0; i < ZTEST_PAGES; i++) {
+        pages[i] = kalloc_nozero();
+        for (int j = 0; j < PGSIZE; j++) {
+            *((char*)pages[i] + j) = 0;
+        }
+    }
+    uint64 byte_time = get_time() - start;
+    for (int i = 0; i < ZTEST_PAGES; i++) {
+        kfree(pages[i]);
+    }
+
+    printf("  %d pages: pre-zeroed pool %lu ticks, byte-wise zeroing %lu ticks\n",
+           ZTEST_PAGES, pool_time, byte_time);
+
+    // 3. 取空整个池，后台线程应在几个节拍内把池补回来
+    while (kalloc_zpool_count() > 0) {
+        kfree(kalloc_zeroed());
+    }
+    wait_zpool(ZTEST_PAGES);
+    printf("  pool refilled to %d pages\n", kalloc_zpool_count());
+    assert(kalloc_zpool_count() >= ZTEST_PAGES);
+    wait_zpool_idle();
+    kalloc_dump_stats();
+    assert(kfreemem() == free_before);
+    printf("Pre-zeroed page pool test passed\n");
+}
+
+// TLB 压力：每页读一个字，跨越 TLB_BLOCKS 个 4MB 块
+#define TLB_BLOCKS  4
+#define TLB_ROUNDS  20
+
+static uint64 tlb_touch(char **blocks) {
+    uint64 sum = 0;
+    uint64 start = get_time();
+    for (int r = 0; r < TLB_ROUNDS; r++) {
+        for (int off = 0; off < (PGSIZE << (MAX_ORDER - 1)); off += PGSIZE) {
+            for (int b = 0; b < TLB_BLOCKS; b++) {
+                sum += *(volatile uint64*)(blocks[b] + off);
+            }
+        }
+    }
+    uint64 elapsed = get_time() - start;
+    assert(sum == 0);
+    return elapsed;
+}
+
+static void test_megapage_tlb(void) {
+    printf("\n=== Perf Test 5: Kernel Direct Map with Megapages ===\n");
+    extern pagetable_t kernel_pagetable;
+    char *blocks[TLB_BLOCKS];
+    for (int b = 0; b < TLB_BLOCKS; b++) {
+        blocks[b] = kalloc_pages(MAX_ORDER - 1);
+        assert(blocks[b] != 0);
+    }
+
+    // 大页映射下 walk 返回的是高级别的叶子 PTE，仍然有效
+    pte_t *pte = walk_lookup(kernel_pagetable, (uint64)blocks[0]);
+    assert(pte != 0 && (*pte & PTE_V) && (*pte & (PTE_R | PTE_W)));
+
+    // 构建一个只使用 4KB 页的同构内核页表作对照
+    pagetable_t pt4k = kvmmake(0);
+    vm_dump_stats("kernel", kernel_pagetable);
+    vm_dump_stats("4K-only", pt4k);
+    assert(vm_ptpages(kernel_pagetable) < vm_ptpages(pt4k));
+
+    uint64 pages = (uint64)TLB_ROUNDS * TLB_BLOCKS * ((PGSIZE << (MAX_ORDER - 1)) / PGSIZE);
+    push_off();
+    w_satp(MAKE_SATP(pt4k));
+    sfence_vma();
+    uint64 small_time = tlb_touch(blocks);
+    w_satp(MAKE_SATP(kernel_pagetable));
+    sfence_vma();
+    uint64 huge_time = tlb_touch(blocks);
+    pop_off();
+
+    printf("  %lu page touches: 4K map %lu ticks, megapage map %lu ticks\n",
+           pages, small_time, huge_time);
+
+    freewalk(pt4k);
+    for (int b = 0; b < TLB_BLOCKS; b++) {
+        kfree_pages(blocks[b], MAX_ORDER - 1);
+    }
+    printf("Megapage direct map test passed\n");
+}
+
+// 每个 worker 做固定量的纯计算，并记录自己运行过的 CPU
+#define SMP_SPIN 2000000
+
+static volatile uint64 smp_cpu_mask;
+
+static void smp_worker(void) {
+    volatile uint64 x = 0;
+    for (int i = 0; i < SMP_SPIN; i++) {
+        x += i;
+        if ((i & 0xffff) == 0) {
+            push_off();
+            __atomic_fetch_or(&smp_cpu_mask, 1UL << cpuid(), __ATOMIC_RELAXED);
+            pop_off();
+        }
+    }
+}
+
+static uint64 smp_run(int workers) {
+    uint64 start = get_time();
+    for (int i = 0; i < workers; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            smp_worker();
+            stub_exit(0);
+        }
+    }
+    for (int i = 0; i < workers; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    return get_time() - start;
+}
+
+static void test_smp_parallel(void) {
+    printf("\n=== Perf Test 6: SMP Parallel Workers ===\n");
+    int ncpu = machine.ncpu;
+
+    uint64 t1 = smp_run(1);
+    smp_cpu_mask = 0;
+    uint64 tn = smp_run(ncpu);
+    int used = 0;
+    for (int i = 0; i < NCPU; i++) {
+        if (smp_cpu_mask & (1UL << i))
+            used++;
+    }
+    if (tn == 0) tn = 1;
+    printf("  1 worker: %lu ticks; %d workers: %lu ticks on %d hart(s), throughput x%lu.%lu\n",
+           t1, ncpu, tn, used, t1 * ncpu / tn, (t1 * ncpu * 10 / tn) % 10);
+    assert(used >= 1 && used <= ncpu);
+    if (ncpu > 1)
+        assert(used > 1);
+    printf("SMP parallel test passed\n");
+}
+
+// 睡眠进程不在运行队列中，yield 的开销不应随进程总数增长
+#define RUNQ_YIELDS   5000
+#define RUNQ_SLEEPERS 200
+
+static struct spinlock runq_test_lock;
+static volatile int runq_test_release;
+
+static uint64 yield_cost_ns(void) {
+    uint64 start = get_time();
+    for (int i = 0; i < RUNQ_YIELDS; i++) {
+        yield();
+    }
+    uint64 elapsed = get_time() - start;
+    return elapsed * 1000000000UL / machine.timebase / RUNQ_YIELDS;
+}
+
+static void test_runq_scaling(void) {
+    printf("\n=== Perf Test 7: Per-CPU Run Queues ===\n");
+    spinlock_init(&runq_test_lock, "runq_test");
+    runq_test_release = 0;
+
+    uint64 few = yield_cost_ns();
+
+    int created = 0;
+    for (int i = 0; i < RUNQ_SLEEPERS; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            acquire(&runq_test_lock);
+            while (!runq_test_release)
+                sleep((void*)&runq_test_release, &runq_test_lock);
+            release(&runq_test_lock);
+            stub_exit(0);
+        }
+        if (pid > 0)
+            created++;
+    }
+    // 等所有子进程都进入睡眠，运行队列里只剩本进程
+    uint64 start = get_ticks();
+    while (runq_total() > 0 && get_ticks() - start < 100)
+        yield();
+
+    uint64 many = yield_cost_ns();
+    printf("  yield: %lu ns with %d processes, %lu ns with %d sleeping processes\n",
+           few, ptable.count - created, many, created);
+
+    acquire(&runq_test_lock);
+    runq_test_release = 1;
+    wakeup((void*)&runq_test_release);
+    release(&runq_test_lock);
+    for (int i = 0; i < created; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    sched_dump_stats();
+    assert(created == RUNQ_SLEEPERS);
+    printf("Run queue test passed\n");
+}
+
+// 比 hart 数多的纯计算进程：只有时间片抢占才能让它们轮流运行
+#define PREEMPT_SPIN 20000000
+
+static volatile uint64 preempt_involuntary;
+static volatile uint64 preempt_first_done;
+static volatile uint64 preempt_last_done;
+
+static void cpu_hog(void) {
+    volatile uint64 x = 0;
+    for (int i = 0; i < PREEMPT_SPIN; i++) {
+        x += i;
+    }
+    uint64 now = get_time();
+    __atomic_fetch_add(&preempt_involuntary, myproc()->nr_involuntary_switches, __ATOMIC_RELAXED);
+    uint64 first = preempt_first_done;
+    while ((first == 0 || now < first) &&
+           !__atomic_compare_exchange_n(&preempt_first_done, &first, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    uint64 last = preempt_last_done;
+    while (now > last &&
+           !__atomic_compare_exchange_n(&preempt_last_done, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void test_preemption(void) {
+    printf("\n=== Perf Test 8: Timer Preemption (quantum=%d ticks) ===\n", sched_get_quantum());
+    int nhog = machine.ncpu + 1;
+    preempt_involuntary = 0;
+    preempt_first_done = 0;
+    preempt_last_done = 0;
+
+    uint64 start = get_time();
+    for (int i = 0; i < nhog; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            cpu_hog();
+            stub_exit(0);
+        }
+    }
+    for (int i = 0; i < nhog; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+
+    // 轮转时所有进程几乎同时结束；不抢占时第一个要比最后一个早一整段运行时间
+    uint64 total = preempt_last_done - start;
+    uint64 spread = preempt_last_done - preempt_first_done;
+    printf("  %d CPU-bound processes on %d hart(s): %lu involuntary switches\n",
+           nhog, machine.ncpu, preempt_involuntary);
+    printf("  completion spread %lu ticks of %lu ticks total\n", spread, total);
+    assert(preempt_involuntary > 0);
+    printf("Preemption test passed\n");
+}
+
+// 交互进程每个节拍睡眠一次，与一直占用 CPU 的进程和一个 nice 19 的
+// 批处理进程混合运行：交互进程的排队延迟应远低于计算进程，批处理进程也要能完成
+#define MLFQ_WAKES       100
+#define MLFQ_BATCH_SPIN  2000000
+#define MLFQ_TIMEOUT     2000   // 节拍
+
+static volatile int mlfq_stop;
+static volatile int mlfq_inter_done;
+static volatile int mlfq_batch_done;
+static volatile uint64 mlfq_inter_delay;    // 交互进程平均每次的排队延迟
+static volatile uint64 mlfq_hog_delay;      // 所有计算进程的累计排队延迟
+static volatile uint64 mlfq_hog_runs;
+
+static void sleep_one_tick(void) {
+    stub_sleep(1);
+}
+
+static void mlfq_hog(void) {
+    volatile uint64 x = 0;
+    while (!mlfq_stop) {
+        x++;
+    }
+    struct proc *p = myproc();
+    __atomic_fetch_add(&mlfq_hog_delay, p->run_delay, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&mlfq_hog_runs, p->nr_runs, __ATOMIC_RELAXED);
+}
+
+static void test_mlfq(void) {
+    printf("\n=== Perf Test 9: MLFQ Scheduling (%d levels, boost every %d ticks) ===\n",
+           MLFQ_LEVELS, MLFQ_BOOST_TICKS);
+    mlfq_stop = 0;
+    mlfq_inter_done = 0;
+    mlfq_batch_done = 0;
+    mlfq_inter_delay = 0;
+    mlfq_hog_delay = 0;
+    mlfq_hog_runs = 0;
+
+    int nhog = 2 * machine.ncpu;
+    int nchild = 0;
+    for (int i = 0; i < nhog; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            mlfq_hog();
+            stub_exit(0);
+        }
+        if (pid > 0)
+            nchild++;
+    }
+
+    // 批处理进程：nice 19，从最低优先级开始，只能靠优先级提升与底层轮转得到 CPU
+    uint64 start = get_ticks();
+    int pid = stub_fork();
+    if (pid == 0) {
+        stub_setpriority(0, NICE_MAX);
+        volatile uint64 x = 0;
+        for (int i = 0; i < MLFQ_BATCH_SPIN; i++) {
+            x += i;
+        }
+        mlfq_batch_done = get_ticks() - start + 1;
+        stub_exit(0);
+    }
+    if (pid > 0)
+        nchild++;
+
+    // 交互进程
+    pid = stub_fork();
+    if (pid == 0) {
+        for (int i = 0; i < MLFQ_WAKES; i++) {
+            sleep_one_tick();
+        }
+        struct proc *p = myproc();
+        mlfq_inter_delay = p->run_delay / p->nr_runs;
+        mlfq_inter_done = 1;
+        stub_exit(0);
+    }
+    if (pid > 0)
+        nchild++;
+
+    int levels[MLFQ_LEVELS];
+    int sampled = 0;
+    while ((!mlfq_inter_done || !mlfq_batch_done) && get_ticks() - start < MLFQ_TIMEOUT) {
+        sleep_one_tick();
+        if (!sampled && get_ticks() - start >= MLFQ_BOOST_TICKS / 2) {
+            runq_level_lengths(levels);
+            sampled = 1;
+        }
+    }
+    int inter_done = mlfq_inter_done;
+    uint64 batch_ticks = mlfq_batch_done;
+    mlfq_stop = 1;
+    for (int i = 0; i < nchild; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+
+    if (sampled) {
+        printf("  runnable per level after %d ticks:", MLFQ_BOOST_TICKS / 2);
+        for (int l = 0; l < MLFQ_LEVELS; l++) {
+            printf(" L%d=%d", l, levels[l]);
+        }
+        printf("\n");
+    }
+    uint64 hog_delay = mlfq_hog_runs ? mlfq_hog_delay / mlfq_hog_runs : 0;
+    printf("  %d hogs on %d hart(s): interactive wait %lu us/run, hog wait %lu us/run\n",
+           nhog, machine.ncpu, mlfq_inter_delay * 1000000 / machine.timebase,
+           hog_delay * 1000000 / machine.timebase);
+    printf("  nice %d batch job finished in %lu ticks\n", NICE_MAX, batch_ticks);
+    sched_dump_stats();
+    assert(nchild == nhog + 2);
+    assert(inter_done);
+    assert(batch_ticks > 0);
+    assert(mlfq_inter_delay < hog_delay);
+    printf("MLFQ test passed\n");
+}
+
+// 三个调度组按 1:2:4 的权重分享同一个 CPU，第三组有两个进程，
+// 组内平分组的份额。所有计算进程绑定在同一个 CPU 上，份额不受窃取影响
+#define CFS_WORKERS     4
+#define CFS_WARMUP      20      // 节拍
+#define CFS_WINDOW      300
+#define CFS_TOLERANCE   30      // 千分比
+
+static const int cfs_worker_group[CFS_WORKERS] = { 1, 2, 3, 3 };
+static const int cfs_group_weight[4] = { 0, 1024, 2048, 4096 };
+static volatile uint64 cfs_count[CFS_WORKERS];
+static volatile int cfs_started;
+static volatile int cfs_stop;
+
+static void cfs_worker(int id, int cpu) {
+    stub_setgroup(0, cfs_worker_group[id]);
+    stub_setaffinity(0, cpu);
+    yield();    // 下次入队时迁到目标 CPU
+    __atomic_fetch_add(&cfs_started, 1, __ATOMIC_RELAXED);
+    while (!cfs_stop) {
+        cfs_count[id]++;
+    }
+}
+
+// 一个进程先在 CPU 上单独运行一段时间，之后第二个进程到来：
+// 两者应当立即平分 CPU，先来的进程不能因为单独运行过而被饿住
+#define CFS_ALONE_TICKS 100
+#define CFS_LATE_WINDOW 100
+#define CFS_LATE_TOLERANCE 100  // 千分比
+
+static void cfs_late_worker(int id, int cpu) {
+    stub_setaffinity(0, cpu);
+    yield();
+    __atomic_fetch_add(&cfs_started, 1, __ATOMIC_RELAXED);
+    while (!cfs_stop) {
+        cfs_count[id]++;
+    }
+}
+
+static int cfs_late_arrival(int cpu) {
+    cfs_started = 0;
+    cfs_stop = 0;
+    cfs_count[0] = cfs_count[1] = 0;
+    int nchild = 0;
+    for (int i = 0; i < 2; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            cfs_late_worker(i, cpu);
+            stub_exit(0);
+        }
+        if (pid > 0)
+            nchild++;
+        while (cfs_started < nchild)
+            sleep_one_tick();
+        if (i == 0) {
+            for (int t = 0; t < CFS_ALONE_TICKS; t++)
+                sleep_one_tick();
+        }
+    }
+
+    uint64 a0 = cfs_count[0], b0 = cfs_count[1];
+    for (int t = 0; t < CFS_LATE_WINDOW; t++)
+        sleep_one_tick();
+    uint64 a = cfs_count[0] - a0, b = cfs_count[1] - b0;
+    cfs_stop = 1;
+    for (int i = 0; i < nchild; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+
+    int share = a + b ? a * 1000 / (a + b) : 0;
+    printf("  late arrival after %d ticks alone: first task share %d.%d%% (expected 50%%)\n",
+           CFS_ALONE_TICKS, share / 10, share % 10);
+    assert(nchild == 2);
+    return share > 500 ? share - 500 : 500 - share;
+}
+
+static void test_cfs_shares(void) {
+    const char *old = sched_policy_name();
+    assert(sched_set_policy("cfs") == 0);
+    printf("\n=== Perf Test 10: CFS Group Shares (was %s) ===\n", old);
+    int cpu = machine.ncpu - 1;
+    cfs_started = 0;
+    cfs_stop = 0;
+    for (int g = 1; g < 4; g++) {
+        assert(stub_groupweight(g, cfs_group_weight[g]) == 0);
+    }
+
+    int nchild = 0;
+    for (int i = 0; i < CFS_WORKERS; i++) {
+        cfs_count[i] = 0;
+        int pid = stub_fork();
+        if (pid == 0) {
+            cfs_worker(i, cpu);
+            stub_exit(0);
+        }
+        if (pid > 0)
+            nchild++;
+    }
+    while (cfs_started < nchild)
+        sleep_one_tick();
+    for (int i = 0; i < CFS_WARMUP; i++)
+        sleep_one_tick();
+
+    uint64 before[CFS_WORKERS], after[CFS_WORKERS];
+    for (int i = 0; i < CFS_WORKERS; i++)
+        before[i] = cfs_count[i];
+    for (int i = 0; i < CFS_WINDOW; i++)
+        sleep_one_tick();
+    for (int i = 0; i < CFS_WORKERS; i++)
+        after[i] = cfs_count[i];
+    cfs_stop = 1;
+    for (int i = 0; i < nchild; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+
+    uint64 group[4] = { 0 }, total = 0;
+    for (int i = 0; i < CFS_WORKERS; i++) {
+        group[cfs_worker_group[i]] += after[i] - before[i];
+        total += after[i] - before[i];
+    }
+    int wsum = cfs_group_weight[1] + cfs_group_weight[2] + cfs_group_weight[3];
+    int worst = 0;
+    for (int g = 1; g < 4; g++) {
+        int share = total ? group[g] * 1000 / total : 0;
+        int expect = cfs_group_weight[g] * 1000 / wsum;
+        int err = share > expect ? share - expect : expect - share;
+        if (err > worst)
+            worst = err;
+        printf("  group %d weight %d: share %d.%d%% (expected %d.%d%%)\n",
+               g, cfs_group_weight[g], share / 10, share % 10, expect / 10, expect % 10);
+    }
+    printf("  %d workers pinned to cpu%d, max error %d.%d%%\n",
+           nchild, cpu, worst / 10, worst % 10);
+    sched_dump_stats();
+
+    for (int g = 1; g < 4; g++) {
+        stub_groupweight(g, 1024);
+    }
+    int late_err = cfs_late_arrival(cpu);
+    sched_set_policy(old);
+    assert(nchild == CFS_WORKERS);
+    assert(worst <= CFS_TOLERANCE);
+    assert(late_err <= CFS_LATE_TOLERANCE);
+    printf("CFS share test passed\n");
+}
+
+// 两个周期实时任务与比 hart 数多的计算进程一起运行：每个作业只需要
+// 半个节拍，EDF 优先于普通进程，所有作业都应在截止时间之前完成
+#define EDF_TASKS 2
+#define EDF_JOBS  50
+
+static const int edf_param[EDF_TASKS][3] = {
+    // runtime, deadline, period (节拍)
+    { 2, 5, 10 },
+    { 1, 3, 5 },
+};
+static volatile uint64 edf_jobs[EDF_TASKS];
+static volatile uint64 edf_misses[EDF_TASKS];
+static volatile int edf_admitted[EDF_TASKS];
+static volatile int edf_stop;
+
+static void edf_task(int id) {
+    uint64 work = machine.timebase / TICK_HZ / 2;
+    if (stub_setdeadline(edf_param[id][0], edf_param[id][1], edf_param[id][2]) < 0)
+        return;
+    edf_admitted[id] = 1;
+    for (int j = 0; j < EDF_JOBS; j++) {
+        uint64 start = get_time();
+        while (get_time() - start < work)
+            ;
+        stub_dl_yield();
+    }
+    struct proc *p = myproc();
+    edf_jobs[id] = p->dl_jobs;
+    edf_misses[id] = p->dl_misses;
+}
+
+static void test_edf_deadlines(void) {
+    printf("\n=== Perf Test 11: EDF Real-Time Class ===\n");
+    int nhog = machine.ncpu + 1;
+    uint64 misses_before = sched_dl_misses();
+    edf_stop = 0;
+
+    // 准入控制：利用率 100% 的任务超过了每个 CPU 的上限
+    assert(stub_setdeadline(10, 10, 10) < 0);
+
+    int nchild = 0;
+    for (int i = 0; i < nhog; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            volatile uint64 x = 0;
+            while (!edf_stop)
+                x++;
+            stub_exit(0);
+        }
+        if (pid > 0)
+            nchild++;
+    }
+    for (int i = 0; i < EDF_TASKS; i++) {
+        edf_jobs[i] = edf_misses[i] = 0;
+        edf_admitted[i] = 0;
+        int pid = stub_fork();
+        if (pid == 0) {
+            edf_task(i);
+            stub_exit(0);
+        }
+    }
+    for (int i = 0; i < EDF_TASKS; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    edf_stop = 1;
+    for (int i = 0; i < nchild; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+
+    for (int i = 0; i < EDF_TASKS; i++) {
+        printf("  task %d (runtime %d, deadline %d, period %d): %lu jobs, %lu deadline misses\n",
+               i, edf_param[i][0], edf_param[i][1], edf_param[i][2], edf_jobs[i], edf_misses[i]);
+    }
+    uint64 misses = sched_dl_misses() - misses_before;
+    printf("  %d CPU-bound processes on %d hart(s), %lu misses in total\n",
+           nhog, machine.ncpu, misses);
+    for (int i = 0; i < EDF_TASKS; i++) {
+        assert(edf_admitted[i]);
+        assert(edf_jobs[i] == EDF_JOBS);
+    }
+    assert(misses == 0);
+    printf("EDF test passed\n");
+}
+
+// wakeup() 只访问 chan 所在的桶：其他 chan 上睡眠的进程再多，开销也不变；
+// wakeup_one() 每次只让一个等待者醒来
+#define WQ_SLEEPERS 200
+#define WQ_WAKEUPS  10000
+#define WQ_HERD     8
+
+static struct spinlock wq_test_lock;
+static volatile int wq_release;
+static volatile int wq_sleeping;
+static volatile int wq_wakes;
+static char wq_chan[WQ_SLEEPERS];
+static char wq_idle_chan;
+
+static uint64 wakeup_cost_ns(void) {
+    uint64 start = get_time();
+    for (int i = 0; i < WQ_WAKEUPS; i++) {
+        wakeup(&wq_idle_chan);
+    }
+    return (get_time() - start) * 1000000000UL / machine.timebase / WQ_WAKEUPS;
+}
+
+static void wq_sleeper(void *chan) {
+    acquire(&wq_test_lock);
+    wq_sleeping++;
+    while (!wq_release) {
+        sleep(chan, &wq_test_lock);
+        wq_wakes++;
+    }
+    release(&wq_test_lock);
+}
+
+static void wq_wait_sleeping(int n) {
+    uint64 start = get_ticks();
+    while (wq_sleeping < n && get_ticks() - start < 200)
+        yield();
+    // 计数在 sleep() 之前增加；拿到锁说明它们都已挂入等待队列
+    acquire(&wq_test_lock);
+    release(&wq_test_lock);
+}
+
+static void test_wait_queues(void) {
+    printf("\n=== Perf Test 12: Hashed Wait Queues ===\n");
+    spinlock_init(&wq_test_lock, "wq_test");
+    wq_release = 0;
+    wq_sleeping = 0;
+    wq_wakes = 0;
+
+    uint64 few = wakeup_cost_ns();
+    int created = 0;
+    for (int i = 0; i < WQ_SLEEPERS; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            wq_sleeper(&wq_chan[i]);
+            stub_exit(0);
+        }
+        if (pid > 0)
+            created++;
+    }
+    wq_wait_sleeping(created);
+    uint64 many = wakeup_cost_ns();
+    printf("  wakeup on an idle channel: %lu ns, %lu ns with %d sleepers on other channels\n",
+           few, many, created);
+    assert(wq_wakes == 0);
+
+    acquire(&wq_test_lock);
+    wq_release = 1;
+    for (int i = 0; i < WQ_SLEEPERS; i++) {
+        wakeup(&wq_chan[i]);
+    }
+    release(&wq_test_lock);
+    for (int i = 0; i < created; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    assert(wq_wakes == created);
+
+    // 惊群：同一 chan 上的 WQ_HERD 个等待者，wakeup_one 只唤醒一个
+    wq_release = 0;
+    wq_sleeping = 0;
+    wq_wakes = 0;
+    for (int i = 0; i < WQ_HERD; i++) {
+        if (stub_fork() == 0) {
+            wq_sleeper(&wq_idle_chan);
+            stub_exit(0);
+        }
+    }
+    wq_wait_sleeping(WQ_HERD);
+    acquire(&wq_test_lock);
+    int woken = wakeup_one(&wq_idle_chan);
+    release(&wq_test_lock);
+    uint64 start = get_ticks();
+    while (wq_wakes < 1 && get_ticks() - start < 100)
+        yield();
+    int herd = wq_wakes;
+    acquire(&wq_test_lock);
+    wq_release = 1;
+    wakeup(&wq_idle_chan);
+    release(&wq_test_lock);
+    for (int i = 0; i < WQ_HERD; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    printf("  wakeup_one with %d waiters: %d woken\n", WQ_HERD, herd);
+
+    assert(created == WQ_SLEEPERS);
+    assert(many < few * 4 + 1000);
+    assert(woken == 1 && herd == 1);
+    printf("Wait queue test passed\n");
+}
+
+#define TW_SLEEPERS 7
+#define TW_SLACK    3       // 允许的唤醒延迟 (节拍)
+
+static const int tw_ticks[TW_SLEEPERS] = { 1, 5, 63, 64, 65, 300, 1000 };
+static volatile uint64 tw_late[TW_SLEEPERS];
+static volatile int tw_early[TW_SLEEPERS];
+static volatile uint64 tw_wakeups[TW_SLEEPERS];
+static volatile int tw_fired;
+
+static void tw_callback(void *arg) {
+    tw_fired++;
+}
+
+// 每个进程睡眠不同的节拍数，跨越时间轮的各级槽位边界
+static void tw_sleeper(int i) {
+    struct proc *p = myproc();
+    uint64 wakeups = p->nr_wakeups;
+    uint64 start = stub_uptime();
+    stub_sleep(tw_ticks[i]);
+    uint64 now = stub_uptime();
+    tw_early[i] = now < start + tw_ticks[i];
+    tw_late[i] = now - start - tw_ticks[i];
+    tw_wakeups[i] = p->nr_wakeups - wakeups;
+}
+
+static void test_timer_wheel(void) {
+    printf("\n=== Perf Test 13: Timer Wheel ===\n");
+    assert(stub_uptime() == (int)get_ticks());
+
+    // 取消的定时器不触发，未取消的只触发一次
+    struct timer cancelled = { 0 }, armed = { 0 };
+    tw_fired = 0;
+    timer_add(&cancelled, get_ticks() + 2, tw_callback, 0);
+    timer_add(&armed, get_ticks() + 3, tw_callback, 0);
+    int del = timer_del(&cancelled);
+    stub_sleep(6);
+    int fired = tw_fired;
+    int del_fired = timer_del(&armed);
+    printf("  cancelled timer: del=%d, callbacks fired: %d\n", del, fired);
+
+    int created = 0;
+    for (int i = 0; i < TW_SLEEPERS; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            tw_sleeper(i);
+            stub_exit(0);
+        }
+        if (pid > 0)
+            created++;
+    }
+    for (int i = 0; i < created; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+
+    int ok = 1;
+    for (int i = 0; i < TW_SLEEPERS; i++) {
+        printf("  sleep %d ticks: woken %lu ticks late, %lu wakeups\n",
+               tw_ticks[i], tw_late[i], tw_wakeups[i]);
+        if (tw_early[i] || tw_late[i] > TW_SLACK || tw_wakeups[i] != 1)
+            ok = 0;
+    }
+    timer_dump_stats();
+
+    assert(del == 1 && fired == 1 && del_fired == 0);
+    assert(created == TW_SLEEPERS);
+    assert(ok);
+    printf("Timer wheel test passed\n");
+}
+
+#define TL_IDLE_TICKS 100
+
+static const uint64 tl_sleep_ns[] = { 200000, 1000000, 3300000, 25000000 };
+
+static void test_tickless(void) {
+    printf("\n=== Perf Test 14: Dynamic Ticks and High-Resolution Sleep ===\n");
+
+    // 系统空闲时的时钟中断次数，周期节拍下为 节拍数 * CPU 数
+    uint64 irqs = clock_timer_irqs();
+    uint64 start = get_ticks();
+    stub_sleep(TL_IDLE_TICKS);
+    uint64 ticks = get_ticks() - start;
+    irqs = clock_timer_irqs() - irqs;
+    uint64 periodic = ticks * machine.ncpu;
+    printf("  idle %lu ticks on %d cpus: %lu timer irqs (periodic: %lu), %lu avoided\n",
+           ticks, machine.ncpu, irqs, periodic, periodic > irqs ? periodic - irqs : 0);
+
+    // 睡眠时间远小于一个节拍时也按请求的时间唤醒
+    uint64 tick_ns = 1000000000UL / TICK_HZ;
+    uint64 max_over = 0;
+    int early = 0;
+    for (int i = 0; i < sizeof(tl_sleep_ns) / sizeof(tl_sleep_ns[0]); i++) {
+        uint64 t0 = get_time();
+        stub_nanosleep(tl_sleep_ns[i]);
+        uint64 ns = (get_time() - t0) * 1000000000UL / machine.timebase;
+        uint64 over = ns > tl_sleep_ns[i] ? ns - tl_sleep_ns[i] : 0;
+        printf("  nanosleep %lu ns: slept %lu ns (+%lu)\n", tl_sleep_ns[i], ns, over);
+        // 换算回纳秒时向下取整，允许差一个 time CSR 计数
+        if (ns + 1000000000UL / machine.timebase < tl_sleep_ns[i])
+            early = 1;
+        if (over > max_over)
+            max_over = over;
+    }
+    clock_dump_stats();
+
+    assert(!early);
+    assert(max_over < tick_ns / 2);
+    if (clock_dynamic())
+        assert(irqs < periodic / 2);
+    printf("Tickless test passed\n");
+}
+
+#define IO_REARMS 1000
+#define IO_LOOP   2000000
+
+// 计算过程中发生的时钟中断次数和耗费的周期数，中断越便宜，同样的计算越快
+static void io_compute(const char *path) {
+    uint64 irqs = get_interrupt_count();
+    uint64 start = r_cycle();
+    volatile uint64 sum = 0;
+    for (int i = 0; i < IO_LOOP; i++) {
+        sum += i;
+    }
+    uint64 cycles = r_cycle() - start;
+    irqs = get_interrupt_count() - irqs;
+    printf("  %s: %d-iteration loop took %lu cycles with %lu interrupts (sum %lu)\n",
+           path, IO_LOOP, cycles, irqs, sum);
+}
+
+// 每个节拍设置下一次时钟中断的开销：SBI 调用与直接写 stimecmp
+void test_interrupt_overhead(void) {
+    printf("\n=== Perf Test 15: Timer Programming Overhead ===\n");
+
+    int old = clock_set_sstc(0);
+    uint64 sbi = clock_rearm_cycles(IO_REARMS);
+    printf("  SBI set_timer: %lu cycles per tick\n", sbi);
+    io_compute("SBI");
+
+    uint64 sstc = 0;
+    if (clock_set_sstc(1) >= 0) {
+        sstc = clock_rearm_cycles(IO_REARMS);
+        printf("  stimecmp write: %lu cycles per tick (%lu saved)\n",
+               sstc, sbi > sstc ? sbi - sstc : 0);
+        io_compute("stimecmp");
+    } else {
+        printf("  stimecmp: Sstc not available (make run QEMUCPU=rv64,sstc=on)\n");
+    }
+    clock_set_sstc(old);
+
+    if (machine.sstc)
+        assert(sstc < sbi);
+    printf("Interrupt overhead test passed\n");
+}
+
+#define IDLE_TICKS  50
+#define IDLE_WAKES  20
+
+static struct spinlock idle_test_lock;
+static volatile int idle_go;
+static volatile uint64 idle_sent;
+static volatile uint64 idle_latency;    // 累计唤醒延迟 (time CSR)
+static volatile int idle_woken;
+
+static uint64 idle_total(void) {
+    uint64 t = 0;
+    for (int i = 0; i < machine.ncpu; i++) {
+        t += cpus[i].idle_time;
+    }
+    return t;
+}
+
+// 绑定在另一个 CPU 上反复睡眠；那个 CPU 空闲时只能靠 IPI 及时叫醒
+static void idle_waiter(void) {
+    for (int i = 0; i < IDLE_WAKES; i++) {
+        acquire(&idle_test_lock);
+        while (idle_go <= i)
+            sleep((void*)&idle_go, &idle_test_lock);
+        release(&idle_test_lock);
+        idle_latency += get_time() - idle_sent;
+        idle_woken++;
+    }
+}
+
+static void test_idle(void) {
+    printf("\n=== Perf Test 16: WFI Idle ===\n");
+    spinlock_init(&idle_test_lock, "idle_test");
+
+    // 所有 CPU 空闲时的空闲时间比例
+    uint64 idle = idle_total();
+    uint64 start = get_time();
+    stub_sleep(IDLE_TICKS);
+    uint64 elapsed = (get_time() - start) * machine.ncpu;
+    idle = idle_total() - idle;
+    uint64 permille = idle * 1000 / elapsed;
+    printf("  %d idle ticks on %d cpus: idle %lu.%lu%% of the time\n",
+           IDLE_TICKS, machine.ncpu, permille / 10, permille % 10);
+
+    // 叫醒另一个空闲 CPU 上的进程
+    int cpu = machine.ncpu - 1;
+    idle_go = 0;
+    idle_latency = 0;
+    idle_woken = 0;
+    int pid = stub_fork();
+    if (pid == 0) {
+        stub_setaffinity(0, cpu);
+        idle_waiter();
+        stub_exit(0);
+    }
+    for (int i = 0; i < IDLE_WAKES; i++) {
+        stub_sleep(1);
+        acquire(&idle_test_lock);
+        idle_sent = get_time();
+        idle_go++;
+        wakeup((void*)&idle_go);
+        release(&idle_test_lock);
+        while (idle_woken <= i && get_time() - idle_sent < machine.timebase)
+            yield();
+    }
+    int status = 0;
+    stub_wait(&status);
+    uint64 us = idle_woken ? idle_latency * 1000000 / machine.timebase / idle_woken : 0;
+    printf("  wakeup of a process on idle cpu%d: %lu us average\n", cpu, us);
+    sched_dump_stats();
+
+    assert(permille > 900);
+    assert(idle_woken == IDLE_WAKES);
+    assert(us < 1000000 / TICK_HZ);
+    printf("WFI idle test passed\n");
+}
+
+#define PP_ROUNDS 2000
+
+static struct spinlock pp_lock;
+static volatile int pp_turn;
+static volatile int pp_ready;
+
+// 两个进程绑定在同一个 CPU 上轮流运行。yield 方式下各自反复让出 CPU；
+// sleep 方式下按 pp_turn 交替，一方唤醒另一方后睡眠
+static void pp_player(int me, int cpu, int use_sleep) {
+    stub_setaffinity(0, cpu);
+    yield();    // 迁到目标 CPU 上
+    __atomic_fetch_add(&pp_ready, 1, __ATOMIC_SEQ_CST);
+    while (pp_ready < 2)
+        yield();
+    for (int i = 0; i < PP_ROUNDS; i++) {
+        if (!use_sleep) {
+            yield();
+            continue;
+        }
+        acquire(&pp_lock);
+        while (pp_turn != me)
+            sleep((void*)&pp_turn, &pp_lock);
+        pp_turn = !me;
+        wakeup((void*)&pp_turn);
+        release(&pp_lock);
+    }
+}
+
+// 返回每次进程切换的平均纳秒数
+static uint64 pp_run(int use_sleep) {
+    int cpu = machine.ncpu - 1;
+    pp_turn = 0;
+    pp_ready = 0;
+    uint64 start = get_time();
+    for (int me = 0; me < 2; me++) {
+        if (stub_fork() == 0) {
+            pp_player(me, cpu, use_sleep);
+            stub_exit(0);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    uint64 ns = (get_time() - start) * 1000000000UL / machine.timebase;
+    return ns / (2 * PP_ROUNDS);
+}
+
+static void test_direct_switch(void) {
+    printf("\n=== Perf Test 17: Direct Context Switch (ping-pong, %d rounds) ===\n", PP_ROUNDS);
+    spinlock_init(&pp_lock, "pingpong");
+
+    uint64 direct0 = 0;
+    for (int i = 0; i < machine.ncpu; i++) {
+        direct0 += cpus[i].nr_switch_direct;
+    }
+    uint64 yield_direct = pp_run(0);
+    uint64 sleep_direct = pp_run(1);
+    uint64 direct = 0;
+    for (int i = 0; i < machine.ncpu; i++) {
+        direct += cpus[i].nr_switch_direct;
+    }
+    direct -= direct0;
+
+    int old = sched_set_direct(0);
+    uint64 yield_sched = pp_run(0);
+    uint64 sleep_sched = pp_run(1);
+    sched_set_direct(old);
+
+    printf("  yield/yield:    %lu ns per switch direct, %lu ns via scheduler\n",
+           yield_direct, yield_sched);
+    printf("  sleep/wakeup:   %lu ns per switch direct, %lu ns via scheduler\n",
+           sleep_direct, sleep_sched);
+    printf("  direct switches during the direct runs: %lu\n", direct);
+
+    assert(direct >= PP_ROUNDS);
+    assert(yield_direct < yield_sched);
+    printf("Direct switch test passed\n");
+}
+
+#define SL_TICKS    20      // 每种配置运行的节拍数
+#define SL_MAXHARTS 8
+
+static struct spinlock sl_lock;
+static volatile int sl_go;
+static volatile int sl_stop;
+static volatile int sl_ready;
+static volatile uint64 sl_shared;
+static volatile uint64 sl_count[SL_MAXHARTS];
+
+// 绑定在 CPU me 上反复获取同一把锁，临界区内修改共享数据
+static void sl_worker(int me) {
+    stub_setaffinity(0, me);
+    yield();
+    __atomic_fetch_add(&sl_ready, 1, __ATOMIC_SEQ_CST);
+    while (!sl_go)
+        ;
+    uint64 n = 0;
+    while (!sl_stop) {
+        acquire(&sl_lock);
+        sl_shared++;
+        for (volatile int k = 0; k < 20; k++)
+            ;
+        release(&sl_lock);
+        n++;
+    }
+    sl_count[me] = n;
+}
+
+static void test_spinlock_types(void) {
+    static const char *names[] = { "tas", "ticket", "mcs" };
+    int maxh = machine.ncpu < SL_MAXHARTS ? machine.ncpu : SL_MAXHARTS;
+    printf("\n=== Perf Test 18: Spinlock Types (1..%d harts, %d ticks each) ===\n", maxh, SL_TICKS);
+
+    int ok = 1;
+    for (int type = SPIN_TAS; type <= SPIN_MCS; type++) {
+        for (int h = 1; h <= maxh; h++) {
+            spinlock_init_type(&sl_lock, "sl_bench", type);
+            sl_go = 0;
+            sl_stop = 0;
+            sl_ready = 0;
+            sl_shared = 0;
+            for (int i = 0; i < h; i++) {
+                sl_count[i] = 0;
+                if (stub_fork() == 0) {
+                    sl_worker(i);
+                    stub_exit(0);
+                }
+            }
+            while (sl_ready < h)
+                yield();
+            uint64 start = get_time();
+            sl_go = 1;
+            stub_sleep(SL_TICKS);
+            sl_stop = 1;
+            uint64 elapsed = get_time() - start;
+            for (int i = 0; i < h; i++) {
+                int status = 0;
+                stub_wait(&status);
+            }
+
+            // 吞吐量与 Jain 公平性指数 (sum x)^2 / (n * sum x^2)，1000 表示完全公平
+            uint64 total = 0, sq = 0, min = ~0UL;
+            for (int i = 0; i < h; i++) {
+                uint64 c = sl_count[i] / 16;
+                total += sl_count[i];
+                sq += c * c;
+                if (sl_count[i] < min)
+                    min = sl_count[i];
+            }
+            uint64 scaled = total / 16;
+            uint64 jain = sq ? scaled * scaled * 1000 / (h * sq) : 1000;
+            uint64 ops = elapsed ? total * machine.timebase / elapsed : 0;
+            printf("  %s %d harts: %lu acquisitions/s, fairness %lu.%03lu, min share %lu of %lu\n",
+                   names[type], h, ops, jain / 1000, jain % 1000, min, total);
+            if (sl_shared != total)
+                ok = 0;
+        }
+    }
+
+    assert(ok);
+    printf("Spinlock test passed\n");
+}
+
+#define LS_ROUNDS 10000
+
+// 无竞争时一次 acquire/release 的开销，用来对比 LOCKSTAT=1 与默认编译
+static void test_lockstat(void) {
+    printf("\n=== Perf Test 19: Lock Statistics ===\n");
+
+    struct spinlock lk;
+    spinlock_init(&lk, "ls_bench");
+    uint64 start = r_cycle();
+    for (int i = 0; i < LS_ROUNDS; i++) {
+        acquire(&lk);
+        release(&lk);
+    }
+    printf("  uncontended acquire+release: %lu cycles\n", (r_cycle() - start) / LS_ROUNDS);
+
+    if (stub_lockstat(1) < 0) {
+        printf("  lockstat not compiled in (make LOCKSTAT=1)\n");
+        printf("Lockstat test passed\n");
+        return;
+    }
+
+    // 几个 hart 争同一把锁，再做一些文件操作，让统计里有自旋锁和睡眠锁
+    int h = machine.ncpu < 4 ? machine.ncpu : 4;
+    spinlock_init(&sl_lock, "ls_contended");
+    sl_go = 0;
+    sl_stop = 0;
+    sl_ready = 0;
+    sl_shared = 0;
+    for (int i = 0; i < h; i++) {
+        if (stub_fork() == 0) {
+            sl_worker(i);
+            stub_exit(0);
+        }
+    }
+    while (sl_ready < h)
+        yield();
+    sl_go = 1;
+    for (int i = 0; i < 20; i++) {
+        int fd = stub_open("lockstat_file", O_CREATE | O_RDWR);
+        if (fd >= 0) {
+            stub_write(fd, "lockstat", 8);
+            stub_close(fd);
+        }
+    }
+    stub_unlink("lockstat_file");
+    stub_sleep(5);
+    sl_stop = 1;
+    for (int i = 0; i < h; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+
+    assert(stub_lockstat(0) == 0);
+    printf("Lockstat test passed\n");
+}
+
+#define MX_WAITERS 3
+
+static struct sleeplock mx_lock;
+static volatile int mx_order[MX_WAITERS];
+static volatile int mx_next;
+
+// 与 sl_worker 相同，只是换成睡眠锁
+static void mx_worker(int me) {
+    stub_setaffinity(0, me);
+    yield();
+    __atomic_fetch_add(&sl_ready, 1, __ATOMIC_SEQ_CST);
+    while (!sl_go)
+        ;
+    uint64 n = 0;
+    while (!sl_stop) {
+        acquiresleep(&mx_lock);
+        sl_shared++;
+        for (volatile int k = 0; k < 20; k++)
+            ;
+        releasesleep(&mx_lock);
+        n++;
+    }
+    sl_count[me] = n;
+}
+
+static void test_adaptive_mutex(void) {
+    printf("\n=== Perf Test 20: Adaptive Sleeplock ===\n");
+
+    // 等待者按到达顺序获得锁：关掉自旋，让每个子进程先睡下再创建下一个
+    int old = sleeplock_set_spin(0);
+    initsleeplock(&mx_lock, "mx_bench");
+    mx_next = 0;
+    acquiresleep(&mx_lock);
+    assert(holdingsleep(&mx_lock));
+    for (int i = 0; i < MX_WAITERS; i++) {
+        if (stub_fork() == 0) {
+            acquiresleep(&mx_lock);
+            mx_order[mx_next++] = i;
+            releasesleep(&mx_lock);
+            stub_exit(0);
+        }
+        stub_sleep(2);
+    }
+    releasesleep(&mx_lock);
+    assert(!holdingsleep(&mx_lock));
+    for (int i = 0; i < MX_WAITERS; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    int fifo = 1;
+    for (int i = 0; i < MX_WAITERS; i++) {
+        if (mx_order[i] != i)
+            fifo = 0;
+    }
+    printf("  handoff order: %d %d %d\n", mx_order[0], mx_order[1], mx_order[2]);
+    assert(mx_next == MX_WAITERS && fifo);
+
+    // 短临界区的吞吐量：自旋打开与关闭
+    int h = machine.ncpu < 4 ? machine.ncpu : 4;
+    int ok = 1;
+    for (int spin = 0; spin <= 1; spin++) {
+        sleeplock_set_spin(spin);
+        sl_go = 0;
+        sl_stop = 0;
+        sl_ready = 0;
+        sl_shared = 0;
+        for (int i = 0; i < h; i++) {
+            sl_count[i] = 0;
+            if (stub_fork() == 0) {
+                mx_worker(i);
+                stub_exit(0);
+            }
+        }
+        while (sl_ready < h)
+            yield();
+        uint64 start = get_time();
+        sl_go = 1;
+        stub_sleep(SL_TICKS);
+        sl_stop = 1;
+        uint64 elapsed = get_time() - start;
+        for (int i = 0; i < h; i++) {
+            int status = 0;
+            stub_wait(&status);
+        }
+        uint64 total = 0;
+        for (int i = 0; i < h; i++)
+            total += sl_count[i];
+        printf("  spin %s, %d harts: %lu acquisitions/s\n", spin ? "on" : "off", h,
+               elapsed ? total * machine.timebase / elapsed : 0);
+        if (sl_shared != total)
+            ok = 0;
+        sleeplock_dump_stats();
+    }
+    sleeplock_set_spin(old);
+
+    assert(ok);
+    printf("Adaptive sleeplock test passed\n");
+}
+
+#define PI_HOLD_TICKS 10     // 低优先级进程在临界区内需要的 CPU 时间
+#define PI_HOGS       2
+
+static struct sleeplock pi_lock;
+static volatile int pi_held;
+static volatile int pi_stop;
+static volatile uint64 pi_wait;
+
+// nice 19 的进程拿着锁做一段计算
+static void pi_low(int cpu) {
+    stub_setaffinity(0, cpu);
+    stub_setpriority(0, NICE_MAX);
+    yield();
+    acquiresleep(&pi_lock);
+    pi_held = 1;
+    uint64 need = PI_HOLD_TICKS * machine.timebase / TICK_HZ;
+    uint64 start = myproc()->sum_exec_runtime;
+    while (myproc()->sum_exec_runtime - start < need)
+        ;
+    releasesleep(&pi_lock);
+}
+
+// nice 0 的计算密集进程，抢在锁持有者前面运行
+static void pi_hog(int cpu) {
+    stub_setaffinity(0, cpu);
+    yield();
+    while (!pi_stop)
+        ;
+}
+
+// nice -20 的进程等锁
+static void pi_high(int cpu) {
+    stub_setaffinity(0, cpu);
+    stub_setpriority(0, NICE_MIN);
+    yield();
+    uint64 start = get_time();
+    acquiresleep(&pi_lock);
+    pi_wait = get_time() - start;
+    releasesleep(&pi_lock);
+    pi_stop = 1;
+}
+
+// 三类进程绑在同一个 CPU 上，返回高优先级进程等锁的节拍数
+static uint64 pi_run(int pi) {
+    int cpu = machine.ncpu - 1;
+    sleeplock_set_pi(pi);
+    initsleeplock(&pi_lock, "pi_bench");
+    pi_held = 0;
+    pi_stop = 0;
+    pi_wait = 0;
+
+    if (stub_fork() == 0) {
+        pi_low(cpu);
+        stub_exit(0);
+    }
+    while (!pi_held)
+        yield();
+    for (int i = 0; i < PI_HOGS; i++) {
+        if (stub_fork() == 0) {
+            pi_hog(cpu);
+            stub_exit(0);
+        }
+    }
+    stub_sleep(1);
+    if (stub_fork() == 0) {
+        pi_high(cpu);
+        stub_exit(0);
+    }
+    for (int i = 0; i < PI_HOGS + 2; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    return pi_wait * TICK_HZ / machine.timebase;
+}
+
+static void test_priority_inheritance(void) {
+    printf("\n=== Perf Test 21: Sleeplock Priority Inheritance (%d hogs) ===\n", PI_HOGS);
+
+    uint64 boosted = sleeplock_boosted_waits();
+    uint64 off = pi_run(0);
+    uint64 on = pi_run(1);
+    boosted = sleeplock_boosted_waits() - boosted;
+    printf("  nice %d waiter blocked on nice %d holder (%d ticks of work):\n",
+           NICE_MIN, NICE_MAX, PI_HOLD_TICKS);
+    printf("    inheritance off: %lu ticks\n", off);
+    printf("    inheritance on:  %lu ticks, %lu boosted waits\n", on, boosted);
+    sleeplock_dump_stats();
+
+    // 持有者继承了最高优先级，等待时间只取决于它剩下的计算量
+    assert(boosted >= 1);
+    assert(on <= 2 * PI_HOLD_TICKS);
+    printf("Priority inheritance test passed\n");
+}
+
+#define RW_BLOCKS  8         // 热点文件的块数
+#define RW_TICKS   20
+
+static char rw_buf[SL_MAXHARTS][BSIZE];
+static volatile uint64 rw_passes[SL_MAXHARTS];
+static volatile int rw_bad;
+
+// 反复打开、读完、关闭同一个文件：路径查找共享 / 的锁，读取共享文件的锁
+static void rw_reader(int me) {
+    stub_setaffinity(0, me);
+    yield();
+    __atomic_fetch_add(&sl_ready, 1, __ATOMIC_SEQ_CST);
+    while (!sl_go)
+        ;
+    uint64 n = 0;
+    while (!sl_stop) {
+        int fd = stub_open("rw_hot", O_RDONLY);
+        if (fd < 0) {
+            rw_bad = 1;
+            break;
+        }
+        int total = 0, r;
+        while ((r = stub_read(fd, rw_buf[me], BSIZE)) > 0) {
+            if (rw_buf[me][0] != 'a' + total / BSIZE)
+                rw_bad = 1;
+            total += r;
+        }
+        stub_close(fd);
+        if (total != RW_BLOCKS * BSIZE)
+            rw_bad = 1;
+        n++;
+    }
+    rw_passes[me] = n;
+}
+
+static void test_shared_inode_lock(void) {
+    int maxh = machine.ncpu < SL_MAXHARTS ? machine.ncpu : SL_MAXHARTS;
+    printf("\n=== Perf Test 22: Shared Inode Locks (1..%d readers, %d KB file) ===\n",
+           maxh, RW_BLOCKS * BSIZE / 1024);
+
+    int fd = stub_open("rw_hot", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (int b = 0; b < RW_BLOCKS; b++) {
+        memset(rw_buf[0], 'a' + b, BSIZE);
+        assert(stub_write(fd, rw_buf[0], BSIZE) == BSIZE);
+    }
+    stub_close(fd);
+
+    rw_bad = 0;
+    int old = ilock_set_shared(1);
+    for (int shared = 0; shared <= 1; shared++) {
+        ilock_set_shared(shared);
+        for (int h = 1; h <= maxh; h *= 2) {
+            sl_go = 0;
+            sl_stop = 0;
+            sl_ready = 0;
+            for (int i = 0; i < h; i++) {
+                rw_passes[i] = 0;
+                if (stub_fork() == 0) {
+                    rw_reader(i);
+                    stub_exit(0);
+                }
+            }
+            while (sl_ready < h)
+                yield();
+            uint64 start = get_time();
+            sl_go = 1;
+            stub_sleep(RW_TICKS);
+            sl_stop = 1;
+            uint64 elapsed = get_time() - start;
+            for (int i = 0; i < h; i++) {
+                int status = 0;
+                stub_wait(&status);
+            }
+            uint64 total = 0;
+            for (int i = 0; i < h; i++)
+                total += rw_passes[i];
+            printf("  %s, %d readers: %lu file reads/s\n", shared ? "shared" : "exclusive", h,
+                   elapsed ? total * machine.timebase / elapsed : 0);
+        }
+    }
+    ilock_set_shared(old);
+    stub_unlink("rw_hot");
+
+    assert(!rw_bad);
+    printf("Shared inode lock test passed\n");
+}
+
+// 每个 hart 上一个进程反复 fork 立即退出的子进程并 wait。一半的子进程先迁到
+// 另一个 hart 再退出，使 exit() 的唤醒与父进程在 wait() 中扫描、入睡并发发生；
+// 丢失一次唤醒，对应的进程就永远睡下去，主进程等待超时
+#define FEW_ROUNDS  300
+#define FEW_TIMEOUT 2000        // 节拍
+
+static volatile int few_done;
+static volatile int few_bad;
+
+static void few_worker(int cpu) {
+    stub_setaffinity(0, cpu);
+    yield();
+    for (int r = 0; r < FEW_ROUNDS; r++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            if (r & 1) {
+                stub_setaffinity(0, (cpu + 1) % machine.ncpu);
+                yield();
+            }
+            stub_exit(r);
+        }
+        int status = -1;
+        if (pid < 0 || stub_wait(&status) != pid || status != r)
+            __atomic_fetch_add(&few_bad, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&few_done, 1, __ATOMIC_RELAXED);
+}
+
+static void test_fork_exit_wait(void) {
+    printf("\n=== Perf Test 23: fork/exit/wait Stress ===\n");
+    few_done = 0;
+    few_bad = 0;
+    int nworker = machine.ncpu;
+    int nchild = 0;
+    uint64 start = get_time();
+    for (int i = 0; i < nworker; i++) {
+        int pid = stub_fork();
+        if (pid == 0) {
+            few_worker(i);
+            stub_exit(0);
+        }
+        if (pid > 0)
+            nchild++;
+    }
+
+    uint64 t0 = get_ticks();
+    while (few_done < nchild && get_ticks() - t0 < FEW_TIMEOUT)
+        sleep_one_tick();
+    uint64 elapsed = get_time() - start;
+    int done = few_done;
+    printf("  %d/%d workers finished %d fork+exit+wait rounds each, %lu rounds/s\n",
+           done, nchild, FEW_ROUNDS,
+           elapsed ? (uint64)done * FEW_ROUNDS * machine.timebase / elapsed : 0);
+    // 有进程丢失唤醒时不能再 wait 它，直接报错
+    assert(done == nworker);
+    for (int i = 0; i < nchild; i++) {
+        int status = 0;
+        stub_wait(&status);
+    }
+    assert(few_bad == 0);
+    printf("fork/exit/wait stress test passed\n");
+}
+
 // 存根
 void test_physical_memory(void) {}
 void test_pagetable(void) {}
 void test_virtual_memory(void) {}
 void test_timer_interrupt(void) {}
 void test_exception_handling(void) {}
-void test_interrupt_overhead(void) {}
 void run_all_tests(void) {}
 void run_lab4_tests(void) {}
 void run_lab5_tests(void) {}
\ No newline at end of file
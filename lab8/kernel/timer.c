@@ -0,0 +1,295 @@
+// kernel/timer.c
+// 分层时间轮：TW_LEVELS 级，每级 TW_SIZE 个槽位。第 0 级的槽位对应接下来的
+// 每一个节拍，第 l 级的一个槽位覆盖 TW_SIZE^l 个节拍。定时器按到期时间与
+// 当前时间的距离放进对应的级别，加入/删除都是 O(1)；低一级转完一圈时把
+// 高一级当前槽位中的定时器重新分配到低级 (级联)，每个节拍只处理一个槽位，
+// 与等待中的定时器总数无关。
+//
+// 高精度定时器 (hrtimer_add) 以 time CSR 计时，按到期时间放在一个有序链表中，
+// 到期时刻直接设为某个 CPU 的下一次时钟中断 (见 trap.c 的 clock_kick)。
+//
+// 进程睡眠 (sleep_until/sleep_ticks/sleep_ns) 使用嵌在 proc 中的定时器，
+// 只在到期时被唤醒一次，而不是每个节拍都醒来检查时间。
+#include "defs.h"
+
+#define TW_BITS   6
+#define TW_SIZE   (1 << TW_BITS)
+#define TW_MASK   (TW_SIZE - 1)
+#define TW_LEVELS 4
+#define TW_RANGE  (1UL << (TW_BITS * TW_LEVELS))   // 能直接表示的最远距离
+#define TW_NONE   (~0UL)
+
+// timer.pending 的取值：在时间轮槽位中，或在高精度定时器链表中
+#define TIMER_WHEEL 1
+#define TIMER_HR    2
+
+static struct {
+    struct spinlock lock;
+    uint64 now;                 // 已经处理过的最后一个节拍
+    struct timer slot[TW_LEVELS][TW_SIZE];  // 各槽位的链表哨兵
+    struct timer hr;            // 高精度定时器链表的哨兵，按到期时刻排序
+    uint64 next;                // 时间轮下一次需要处理的节拍，可能偏早
+    volatile uint64 deadline;   // 最早需要处理定时器的时刻 (time CSR)，无锁读取
+    uint64 nr_pending;
+    uint64 nr_wheel;            // 其中在时间轮槽位中的个数，为 0 时 now 可以直接跳到当前节拍
+    uint64 nr_added;
+    uint64 nr_fired;
+    uint64 nr_cascaded;         // 级联时被重新分配的次数
+} wheel;
+
+void timer_init(void) {
+    spinlock_init(&wheel.lock, "timer_wheel");
+    wheel.now = get_ticks();
+    for (int l = 0; l < TW_LEVELS; l++) {
+        for (int i = 0; i < TW_SIZE; i++) {
+            wheel.slot[l][i].next = wheel.slot[l][i].prev = &wheel.slot[l][i];
+        }
+    }
+    wheel.hr.next = wheel.hr.prev = &wheel.hr;
+    wheel.next = TW_NONE;
+    wheel.deadline = TW_NONE;
+}
+
+static void timer_update_deadline(void) {
+    uint64 d = wheel.next == TW_NONE ? TW_NONE : clock_tick_time(wheel.next);
+    if (wheel.hr.next != &wheel.hr && wheel.hr.next->expires < d)
+        d = wheel.hr.next->expires;
+    wheel.deadline = d;
+}
+
+// 时间轮中最早需要处理的节拍：第 0 级中最近的非空槽位，或高一级中最近的
+// 非空槽位开始级联的节拍。后者早于其中定时器的到期时间，到时会重新计算
+static uint64 timer_scan_next(void) {
+    uint64 next = TW_NONE;
+    for (int l = 0; l < TW_LEVELS; l++) {
+        uint64 base = wheel.now >> (TW_BITS * l);
+        for (uint64 k = 1; k <= TW_SIZE; k++) {
+            struct timer *head = &wheel.slot[l][(base + k) & TW_MASK];
+            if (head->next != head) {
+                uint64 t = (base + k) << (TW_BITS * l);
+                if (t < next)
+                    next = t;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+// 按到期时间放入槽位，调用者持有 wheel.lock
+static void timer_insert(struct timer *t) {
+    uint64 expires = t->expires;
+    // 已经过期的定时器在下一个节拍触发
+    if (expires <= wheel.now)
+        expires = wheel.now + 1;
+    uint64 delta = expires - wheel.now;
+    if (delta >= TW_RANGE) {
+        // 太远的定时器先放在最高级最远的槽位，级联时再重新计算
+        delta = TW_RANGE - 1;
+        expires = wheel.now + delta;
+    }
+
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= (1UL << (TW_BITS * (level + 1))))
+        level++;
+    struct timer *head = &wheel.slot[level][(expires >> (TW_BITS * level)) & TW_MASK];
+
+    t->next = head;
+    t->prev = head->prev;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static void timer_unlink(struct timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = 0;
+    if (t->pending == TIMER_WHEEL)
+        wheel.nr_wheel--;
+    wheel.nr_pending--;
+}
+
+static void timer_add_locked(struct timer *t, uint64 expires) {
+    if (t->pending)
+        timer_unlink(t);
+    // 时间轮空着时没有中断推进 now，先追上当前节拍，新定时器按真实距离放入，
+    // 下一次中断也不必逐个走过空闲期间的节拍
+    if (wheel.nr_wheel == 0) {
+        uint64 ticks = get_ticks();
+        if (ticks > wheel.now)
+            wheel.now = ticks;
+    }
+    t->expires = expires;
+    t->pending = TIMER_WHEEL;
+    timer_insert(t);
+    wheel.nr_pending++;
+    wheel.nr_wheel++;
+    wheel.nr_added++;
+
+    if (expires <= wheel.now)
+        expires = wheel.now + 1;
+    if (expires < wheel.next) {
+        wheel.next = expires;
+        timer_update_deadline();
+        clock_kick(clock_tick_time(expires));
+    }
+}
+
+// 按到期时刻有序插入高精度定时器链表，定时器不多，线性插入即可
+static void hrtimer_add_locked(struct timer *t, uint64 when) {
+    if (t->pending)
+        timer_unlink(t);
+    t->expires = when;
+    t->pending = TIMER_HR;
+    struct timer *pos = wheel.hr.next;
+    while (pos != &wheel.hr && pos->expires <= when)
+        pos = pos->next;
+    t->next = pos;
+    t->prev = pos->prev;
+    pos->prev->next = t;
+    pos->prev = t;
+    wheel.nr_pending++;
+    wheel.nr_added++;
+
+    if (when < wheel.deadline) {
+        wheel.deadline = when;
+        clock_kick(when);
+    }
+}
+
+static int timer_del_locked(struct timer *t) {
+    if (!t->pending)
+        return 0;
+    timer_unlink(t);
+    t->pending = 0;
+    return 1;
+}
+
+// 设置 (或重新设置) 定时器在第 expires 个节拍调用 fn(arg)
+void timer_add(struct timer *t, uint64 expires, void (*fn)(void *), void *arg) {
+    acquire(&wheel.lock);
+    t->fn = fn;
+    t->arg = arg;
+    timer_add_locked(t, expires);
+    release(&wheel.lock);
+}
+
+// 设置 (或重新设置) 高精度定时器在 time CSR 达到 when 时调用 fn(arg)
+void hrtimer_add(struct timer *t, uint64 when, void (*fn)(void *), void *arg) {
+    acquire(&wheel.lock);
+    t->fn = fn;
+    t->arg = arg;
+    hrtimer_add_locked(t, when);
+    release(&wheel.lock);
+}
+
+// 取消定时器 (时间轮或高精度)，返回 1 表示它尚未触发。返回之后回调不会再被调用
+int timer_del(struct timer *t) {
+    acquire(&wheel.lock);
+    int r = timer_del_locked(t);
+    release(&wheel.lock);
+    return r;
+}
+
+// 把第 level 级槽位 idx 中的定时器按新的距离重新放入低级
+static void timer_cascade(int level, int idx) {
+    struct timer *head = &wheel.slot[level][idx];
+    struct timer *t = head->next;
+    head->next = head->prev = head;
+    while (t != head) {
+        struct timer *next = t->next;
+        timer_insert(t);
+        wheel.nr_cascaded++;
+        t = next;
+    }
+}
+
+static void timer_fire(struct timer *t) {
+    timer_unlink(t);
+    t->pending = 0;
+    wheel.nr_fired++;
+    t->fn(t->arg);
+}
+
+// 处理到第 ticks 个节拍为止到期的定时器。停掉节拍后一次中断可能跨过多个节拍，
+// 逐个节拍推进，级联与触发的顺序与每个节拍都中断时相同；
+// 时间轮中已经没有定时器时直接跳到 ticks
+static void timer_run(uint64 ticks) {
+    while (wheel.now < ticks) {
+        if (wheel.nr_wheel == 0) {
+            wheel.now = ticks;
+            break;
+        }
+        uint64 now = ++wheel.now;
+        // 低一级转完一圈：把高一级当前槽位中的定时器分配下来
+        for (int l = 1; l < TW_LEVELS; l++) {
+            if ((now >> (TW_BITS * (l - 1))) & TW_MASK)
+                break;
+            timer_cascade(l, (now >> (TW_BITS * l)) & TW_MASK);
+        }
+
+        struct timer *head = &wheel.slot[0][now & TW_MASK];
+        while (head->next != head)
+            timer_fire(head->next);
+    }
+}
+
+// 由各 CPU 的时钟中断调用：没有到期的定时器时不拿锁
+void timer_interrupt(void) {
+    uint64 now = r_time();
+    if (now < wheel.deadline)
+        return;
+    acquire(&wheel.lock);
+    timer_run(get_ticks());
+    while (wheel.hr.next != &wheel.hr && wheel.hr.next->expires <= now)
+        timer_fire(wheel.hr.next);
+    wheel.next = timer_scan_next();
+    timer_update_deadline();
+    release(&wheel.lock);
+}
+
+// 最早需要处理定时器的时刻，没有定时器时为全 1
+uint64 timer_deadline(void) {
+    return wheel.deadline;
+}
+
+// 当前进程睡眠到第 tick 个节拍 (hr 为 0) 或 time CSR 达到 tick (hr 为 1)。
+// 只在定时器到期时被唤醒一次
+static void timer_sleep(uint64 when, int hr) {
+    struct proc *p = myproc();
+    struct timer *t = &p->sleep_timer;
+
+    acquire(&wheel.lock);
+    t->fn = wakeup;
+    t->arg = t;
+    if (hr)
+        hrtimer_add_locked(t, when);
+    else
+        timer_add_locked(t, when);
+    // 到期时 timer_fire() 持有 wheel.lock 清除 pending 后再唤醒，不会错过
+    while (t->pending)
+        sleep(t, &wheel.lock);
+    release(&wheel.lock);
+}
+
+void sleep_until(uint64 tick) {
+    timer_sleep(tick, 0);
+}
+
+void sleep_ticks(uint64 n) {
+    sleep_until(get_ticks() + n);
+}
+
+// 睡眠 ns 纳秒，精度取决于 time CSR 的频率和中断延迟，而不是节拍
+void sleep_ns(uint64 ns) {
+    uint64 hz = machine.timebase;
+    uint64 delta = ns / 1000000000UL * hz + ns % 1000000000UL * hz / 1000000000UL;
+    timer_sleep(r_time() + delta, 1);
+}
+
+void timer_dump_stats(void) {
+    printf("=== Timer Wheel ===\n");
+    printf("  now=%lu pending=%lu (wheel %lu) added=%lu fired=%lu cascaded=%lu\n",
+           wheel.now, wheel.nr_pending, wheel.nr_wheel, wheel.nr_added, wheel.nr_fired,
+           wheel.nr_cascaded);
+}
@@ -0,0 +1,19 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include "riscv.h"
+
+// 内核定时器：到期 (以时钟节拍或 time CSR 计) 后在某个 CPU 的时钟中断中调用 fn(arg)。
+// 回调在持有时间轮锁、关中断时执行，不能睡眠，也不能再调用 timer_add/timer_del；
+// 它可以调用 wakeup()，锁顺序为 时间轮锁 -> p->lock，
+// 所以持有 p->lock 时不能调用 timer_add/timer_del
+struct timer {
+    struct timer *next;         // 时间轮槽位中的双向循环链表
+    struct timer *prev;
+    uint64 expires;             // 到期的节拍 (高精度定时器为 time CSR 的值)
+    void (*fn)(void *);
+    void *arg;
+    int pending;                // 已加入时间轮 (或高精度链表) 且尚未到期
+};
+
+#endif // __TIMER_H__
@@ -5,10 +5,8 @@
 #include "proc.h" 
 
 extern void kernelvec();
-extern struct proc proc[NPROC]; 
 extern void restore_trapframe(struct trapframe *tf);
 
-static volatile uint64 tick_counter = 0;
 static volatile uint64 total_interrupt_count = 0;
 
 static inline void sbi_set_timer(uint64 stime) {
@@ -18,25 +16,171 @@ static inline void sbi_set_timer(uint64 stime) {
     asm volatile("ecall" : "+r"(a0) : "r"(a6), "r"(a7) : "memory");
 }
 
+// 有 Sstc 时直接写 stimecmp，省去一次陷入 M 模式的 SBI 调用
+static int use_sstc;
+
+static inline void set_timer(uint64 stime) {
+    if (use_sstc)
+        w_stimecmp(stime);
+    else
+        sbi_set_timer(stime);
+}
+
+// SBI IPI 扩展：向 hart_mask_base 起的 hart_mask 中的 hart 发送软件中断
+static inline void sbi_send_ipi(uint64 hart_mask, uint64 hart_mask_base) {
+    register uint64 a7 asm("a7") = 0x735049;   // "sPI"
+    register uint64 a6 asm("a6") = 0;          // send_ipi
+    register uint64 a0 asm("a0") = hart_mask;
+    register uint64 a1 asm("a1") = hart_mask_base;
+    asm volatile("ecall" : "+r"(a0), "+r"(a1) : "r"(a6), "r"(a7) : "memory");
+}
+
+// 叫醒在 wfi 中空闲的 CPU。每次空闲最多发送一次 IPI，返回是否发送了
+int cpu_kick(int cpu) {
+    if (!__atomic_exchange_n(&cpus[cpu].idle, 0, __ATOMIC_SEQ_CST))
+        return 0;
+    sbi_send_ipi(1, machine.hartid[cpu]);
+    return 1;
+}
+
 void trap_init(void) {
     w_stvec((uint64)kernelvec);
+    w_sie(r_sie() | SIE_SSIE);
     printf("trap_init: stvec set to %p\n", kernelvec);
 }
 
+// 两次时钟中断之间的 time CSR 计数，由设备树给出的 timebase 决定
+static uint64 timer_interval;
+// 第 0 个节拍开始的时刻。节拍由 time CSR 换算，不依赖时钟中断的次数
+static uint64 tick_base;
+
+// 动态节拍 (默认开启，启动参数 nohz=off 关闭)：每次中断都按需要设置下一次
+// 中断的时刻。运行进程的 CPU 仍按节拍中断，时间片以节拍计；空闲的 CPU 只在
+// 有定时器到期时才被唤醒，最多隔 NOHZ_IDLE_MAX 个节拍。
+// 定时器由到期时最先进入中断的 CPU 处理。CPU 0 总是为最早的定时器设置中断；
+// 其他 CPU 只在定时器早于 CPU 0 的下一次中断时才设置，避免所有空闲 CPU 一起醒来
+static int nohz = 1;
+
 void clock_init(void) {
-    uint64 next_timer = r_time() + 100000;
-    sbi_set_timer(next_timer);
+    timer_interval = machine.timebase / TICK_HZ;
+    if (cpuid() == 0) {
+        tick_base = r_time();
+        char val[8];
+        if (fdt_bootarg("nohz", val, sizeof(val)) >= 0 && strncmp(val, "off", sizeof(val)) == 0)
+            nohz = 0;
+        use_sstc = machine.sstc;
+        printf("clock: %s ticks at %d Hz, timer via %s\n", nohz ? "dynamic" : "periodic",
+               TICK_HZ, use_sstc ? "stimecmp" : "SBI");
+    }
+    uint64 next_timer = r_time() + timer_interval;
+    mycpu()->timer_deadline = next_timer;
+    set_timer(next_timer);
     w_sie(r_sie() | SIE_STIE);
 }
 
 uint64 get_time(void) { return r_time(); }
 uint64 get_interrupt_count(void) { return total_interrupt_count; }
-uint64 get_ticks(void) { return tick_counter; }
-void* get_ticks_channel(void) { return (void*)&tick_counter; }
+uint64 get_ticks(void) { return (r_time() - tick_base) / timer_interval; }
+
+// 第 tick 个节拍开始的时刻
+uint64 clock_tick_time(uint64 tick) {
+    return tick_base + tick * timer_interval;
+}
+
+// 设置本 CPU 的下一次时钟中断。busy 表示本 CPU 正在运行进程，需要节拍来计算时间片
+static void clock_program(int busy) {
+    struct cpu *c = mycpu();
+    uint64 now = r_time();
+    uint64 next = now + (busy || !nohz ? timer_interval : NOHZ_IDLE_MAX * timer_interval);
+    uint64 d = timer_deadline();
+    if (d < next && (cpuid() == 0 || d < cpus[0].timer_deadline))
+        next = d;
+    c->timer_deadline = next;
+    // 与 clock_kick() 配对：先写出自己的期限再检查定时器，期间加入的更早的
+    // 定时器要么在这里被 CPU 0 看到，要么由加入它的 CPU 自己设置中断
+    __sync_synchronize();
+    if (cpuid() == 0 && (d = timer_deadline()) < next)
+        next = c->timer_deadline = d;
+    set_timer(next);
+}
+
+// 加入了在 when 到期的定时器：早于本 CPU 和 CPU 0 的下一次中断时提前本 CPU 的中断
+void clock_kick(uint64 when) {
+    push_off();
+    struct cpu *c = mycpu();
+    __sync_synchronize();
+    if (when < c->timer_deadline && (cpuid() == 0 || when < cpus[0].timer_deadline)) {
+        c->timer_deadline = when;
+        set_timer(when);
+    }
+    pop_off();
+}
+
+// scheduler() 要运行进程时调用：空闲时推迟的节拍中断恢复为每个节拍一次
+void clock_resume(void) {
+    struct cpu *c = mycpu();
+    uint64 next = r_time() + timer_interval;
+    if (c->timer_deadline > next) {
+        c->timer_deadline = next;
+        set_timer(next);
+    }
+}
+
+// 切换设置时钟中断的方式 (供测试比较)，硬件不支持 Sstc 时返回 -1，否则返回原来的方式
+int clock_set_sstc(int on) {
+    if (on && !machine.sstc)
+        return -1;
+    push_off();
+    int old = use_sstc;
+    use_sstc = on;
+    // 从 stimecmp 切回 SBI 时，SBI 会重新写 stimecmp (OpenSBI 在有 Sstc 时也是这样实现的)
+    set_timer(mycpu()->timer_deadline);
+    pop_off();
+    return old;
+}
+
+// 重设 n 次本 CPU 当前的中断时刻，返回每次的平均周期数，即每个节拍设置中断的开销
+uint64 clock_rearm_cycles(int n) {
+    push_off();
+    uint64 when = mycpu()->timer_deadline;
+    uint64 start = r_cycle();
+    for (int i = 0; i < n; i++) {
+        set_timer(when);
+    }
+    uint64 cycles = r_cycle() - start;
+    pop_off();
+    return n > 0 ? cycles / n : 0;
+}
+
+int clock_dynamic(void) {
+    return nohz;
+}
+
+// 所有 CPU 的时钟中断次数
+uint64 clock_timer_irqs(void) {
+    uint64 n = 0;
+    for (int i = 0; i < machine.ncpu; i++) {
+        n += cpus[i].nr_timer_irqs;
+    }
+    return n;
+}
+
+void clock_dump_stats(void) {
+    uint64 ticks = get_ticks();
+    uint64 irqs = clock_timer_irqs();
+    uint64 periodic = ticks * machine.ncpu;
+    printf("=== Clock (%s ticks) ===\n", nohz ? "dynamic" : "periodic");
+    printf("  ticks=%lu timer irqs=%lu, %lu avoided vs periodic ticks\n",
+           ticks, irqs, periodic > irqs ? periodic - irqs : 0);
+}
 
 void fork_ret() {
     struct proc *p = myproc();
+    mycpu()->intena = 1;
+    switch_finish();
     release(&p->lock); 
+    // 子进程的 trapframe 复制自父进程，其中的 tp 是父进程所在 hart 的
+    p->trapframe->tp = r_tp();
     restore_trapframe(p->trapframe);
 }
 
@@ -56,12 +200,26 @@ void kerneltrap(uint64 sp_val) {
 
     if (scause & (1L << 63)) {
         uint64 cause = scause & 0x7FFFFFFFFFFFFFFF;
-        if (cause == 5) {
-            total_interrupt_count++;
-            tick_counter++;
-            wakeup((void*)&tick_counter);
-            uint64 next_timer = r_time() + 100000;
-            sbi_set_timer(next_timer);
+        if (cause == 1) {
+            // IPI：只用来把 CPU 从 wfi 中叫醒，scheduler() 随后会检查运行队列
+            w_sip(r_sip() & ~SIP_SSIP);
+            mycpu()->nr_ipis++;
+        } else if (cause == 5) {
+            __atomic_fetch_add(&total_interrupt_count, 1, __ATOMIC_RELAXED);
+            mycpu()->nr_timer_irqs++;
+            // 每个 hart 都有自己的时钟中断，由最先看到定时器到期的 hart 处理
+            timer_interrupt();
+            int resched = sched_tick();
+            clock_program(myproc() != 0);
+
+            // 时间片用完且有进程在等待时抢占当前进程。只有陷入前开着中断
+            // (SPIE = 1，因而没有持有自旋锁) 的上下文才能被抢占
+            if (resched && (sstatus & SSTATUS_SPIE)) {
+                preempt();
+                // 返回时可能已在另一个 hart 上，期间的陷入也会改写这两个 CSR
+                w_sepc(sepc);
+                w_sstatus(sstatus);
+            }
         }
     } 
     else if (scause == 3) {
@@ -3,7 +3,6 @@
 
 #include "riscv.h"
 
-#define VIRTIO0             0x10001000
 
 #define VIRTIO_MMIO_MAGIC_VALUE      0x000
 #define VIRTIO_MMIO_VERSION          0x004
@@ -33,8 +33,11 @@ struct disk {
 static uint64 disk_reads;
 static uint64 disk_writes;
 
+// 块设备所在的 virtio-mmio slot，由 virtio_disk_init() 从设备树给出的 slot 中探测
+static uint64 virtio_base;
+
 static inline volatile uint32 *mmio_reg(int off) {
-    return (volatile uint32 *)((uint64)VIRTIO0 + off);
+    return (volatile uint32 *)(virtio_base + off);
 }
 
 static inline uint32 r32(int off) {
@@ -78,16 +81,37 @@ static void free_chain(int i) {
     }
 }
 
+static int alloc3_desc(int *idx) {
+    for (int i = 0; i < 3; i++) {
+        idx[i] = alloc_desc();
+        if (idx[i] < 0) {
+            for (int j = 0; j < i; j++) {
+                free_desc(idx[j]);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
 void virtio_disk_init(void) {
     // ... (保持你现在的 Modern 模式初始化代码不变) ...
     spinlock_init(&disk.lock, "virtio_disk");
 
-    uint32 magic = r32(VIRTIO_MMIO_MAGIC_VALUE);
-    uint32 version = r32(VIRTIO_MMIO_VERSION);
-    uint32 device_id = r32(VIRTIO_MMIO_DEVICE_ID);
-    uint32 vendor_id = r32(VIRTIO_MMIO_VENDOR_ID);
+    // 空的 slot 设备号为 0，取第一个块设备 (device id 2)
+    uint32 magic = 0, version = 0, device_id = 0, vendor_id = 0;
+    for (int i = 0; i < machine.nvirtio; i++) {
+        virtio_base = machine.virtio_base[i];
+        magic = r32(VIRTIO_MMIO_MAGIC_VALUE);
+        version = r32(VIRTIO_MMIO_VERSION);
+        device_id = r32(VIRTIO_MMIO_DEVICE_ID);
+        vendor_id = r32(VIRTIO_MMIO_VENDOR_ID);
+        if (magic == 0x74726976 && device_id == 2)
+            break;
+    }
 
-    printf("virtio: magic=0x%x version=0x%x device=0x%x vendor=0x%x\n", magic, version, device_id, vendor_id);
+    printf("virtio: base=%p magic=0x%x version=0x%x device=0x%x vendor=0x%x\n",
+           virtio_base, magic, version, device_id, vendor_id);
 
     if (magic != 0x74726976 || version != 2 || device_id != 2 || vendor_id != 0x554d4551) {
         panic("virtio_disk_init: cannot find virtio disk");
@@ -149,11 +173,11 @@ void virtio_disk_rw(struct buf *b, int write) {
     int idx[3];
     acquire(&disk.lock);
 
-    for (int i = 0; i < 3; i++) {
-        while ((idx[i] = alloc_desc()) < 0) {
-            // 对于 Lab，这里简单的忙等待是可以的
-            // release(&disk.lock); acquire(&disk.lock);
-        }
+    // 三个描述符要么全部拿到，要么全部放回：多个 hart 各自持有一部分时会互相等死。
+    // 不够时放开锁，让其他 hart 上的请求完成并归还描述符
+    while (alloc3_desc(idx) < 0) {
+        release(&disk.lock);
+        acquire(&disk.lock);
     }
 
     struct virtio_blk_req *cmd = &disk.info[idx[0]].cmd;
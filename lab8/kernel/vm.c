@@ -1,7 +1,6 @@
 // kernel/vm.c
 #include "riscv.h"
 #include "defs.h"
-#include "virtio.h"
 
 // 内核的根页表
 pagetable_t kernel_pagetable;
@@ -10,40 +9,53 @@ pagetable_t kernel_pagetable;
 extern char etext[]; // .text 段的结束地址
 extern char end[];   // 内核的结束地址
 
-// 遍历页表，找到指定虚拟地址对应的PTE。
-static pte_t *walk(pagetable_t pagetable, uint64 va, int alloc) {
+// 各级页的大小：level 0 为 4KB，level 1 为 2MB，level 2 为 1GB
+#define LEVEL_SIZE(level) (1L << (PGSHIFT + 9 * (level)))
+#define PTE_LEAF(pte)     ((pte) & (PTE_R | PTE_W | PTE_X))
+
+// 当前所有页表占用的页数
+static uint64 nr_ptpages;
+
+static pagetable_t alloc_ptpage(void) {
+    pagetable_t pt = (pagetable_t)kalloc_zeroed();
+    if (pt)
+        __atomic_fetch_add(&nr_ptpages, 1, __ATOMIC_RELAXED);
+    return pt;
+}
+
+// 遍历页表到第 level 级，返回该级中 va 对应的 PTE。
+// 途中遇到更高级的叶子 PTE (大页) 时：alloc=0 直接返回它，alloc=1 视为冲突返回 0
+static pte_t *walk_level(pagetable_t pagetable, uint64 va, int alloc, int level) {
     if (va >= (1L << 39)) {
         return 0; // 虚拟地址过大
     }
-    
-    for (int level = 2; level > 0; level--) {
-        pte_t *pte = &pagetable[VPN(va, level)];
+
+    for (int l = 2; l > level; l--) {
+        pte_t *pte = &pagetable[VPN(va, l)];
         if (*pte & PTE_V) {
+            if (PTE_LEAF(*pte)) {
+                return alloc ? 0 : pte;
+            }
             pagetable = (pagetable_t)PTE2PA(*pte);
         } else {
-            if (!alloc || (pagetable = (pagetable_t)kalloc()) == 0) {
+            if (!alloc || (pagetable = alloc_ptpage()) == 0) {
                 return 0; // 分配失败
             }
-            for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
-                pagetable[i] = 0;
-            }
             *pte = PA2PTE(pagetable) | PTE_V;
         }
     }
-    return &pagetable[VPN(va, 0)];
+    return &pagetable[VPN(va, level)];
+}
+
+// 遍历页表，找到指定虚拟地址对应的叶子 PTE (可能是 4KB、2MB 或 1GB 页)。
+static pte_t *walk(pagetable_t pagetable, uint64 va, int alloc) {
+    return walk_level(pagetable, va, alloc, 0);
 }
 
 // ===== 新增: 用于测试的公开函数 =====
 
 pagetable_t create_pagetable(void) {
-    pagetable_t pt = (pagetable_t)kalloc();
-    if (pt == 0) {
-        return 0;
-    }
-    for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
-        pt[i] = 0;
-    }
-    return pt;
+    return alloc_ptpage();
 }
 
 int map_page(pagetable_t pt, uint64 va, uint64 pa, int perm) {
@@ -65,15 +77,22 @@ pte_t *walk_lookup(pagetable_t pt, uint64 va) {
 
 // ===== 原有函数 =====
 
-int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm) {
-    uint64 a, last;
+// 建立 [va, va+size) 到 pa 的映射，max_level 限制可使用的最大页：
+// 在 va、pa 都按某级页对齐且剩余长度足够时使用该级的叶子 PTE
+static int map_range(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm, int max_level) {
+    uint64 a, end;
     pte_t *pte;
 
     a = PGROUNDDOWN(va);
-    last = PGROUNDDOWN(va + size - 1);
+    end = PGROUNDUP(va + size);
+    pa = PGROUNDDOWN(pa);
 
-    for (;;) {
-        if ((pte = walk(pagetable, a, 1)) == 0) {
+    while (a < end) {
+        int level = max_level;
+        while (level > 0 && ((a | pa) % LEVEL_SIZE(level) != 0 || end - a < LEVEL_SIZE(level))) {
+            level--;
+        }
+        if ((pte = walk_level(pagetable, a, 1, level)) == 0) {
             return -1;
         }
         if (*pte & PTE_V) {
@@ -81,40 +100,51 @@ int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
             return -1;
         }
         *pte = PA2PTE(pa) | perm | PTE_V;
-        if (a == last) {
-            break;
-        }
-        a += PGSIZE;
-        pa += PGSIZE;
+        a += LEVEL_SIZE(level);
+        pa += LEVEL_SIZE(level);
     }
     return 0;
 }
 
-// 创建内核页表
-void kvminit(void) {
-    kernel_pagetable = (pagetable_t)kalloc();
-    for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
-        kernel_pagetable[i] = 0;
-    }
+// 尽可能使用 2MB/1GB 大页建立映射
+int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm) {
+    return map_range(pagetable, va, size, pa, perm, 2);
+}
 
-    // 映射 UART 设备
-    if (mappages(kernel_pagetable, 0x10000000, PGSIZE, 0x10000000, PTE_R | PTE_W) < 0)
-        panic("kvminit: uart map failed");
+// 构建内核页表 (恒等映射)；max_level = 0 时只使用 4KB 页，用于对比测试
+pagetable_t kvmmake(int max_level) {
+    pagetable_t pt = alloc_ptpage();
+    if (pt == 0)
+        panic("kvmmake: out of memory");
 
-    // 映射 VirtIO 磁盘 MMIO (0x10001000)
-    // === 修复: 添加错误检查 ===
-    if (mappages(kernel_pagetable, VIRTIO0, PGSIZE, VIRTIO0, PTE_R | PTE_W) < 0)
-        panic("kvminit: virtio map failed");
+    // 映射 UART 设备
+    if (map_range(pt, 0x10000000, PGSIZE, 0x10000000, PTE_R | PTE_W, max_level) < 0)
+        panic("kvmmake: uart map failed");
+
+    // 映射设备树中列出的所有 virtio-mmio slot，每个 slot 一页寄存器
+    for (int i = 0; i < machine.nvirtio; i++) {
+        uint64 va = machine.virtio_base[i];
+        if (map_range(pt, va, PGSIZE, va, PTE_R | PTE_W, max_level) < 0)
+            panic("kvmmake: virtio map failed");
+    }
 
     // 映射内核代码段 (R-X)
-    if (mappages(kernel_pagetable, 0x80200000, (uint64)etext - 0x80200000, 0x80200000, PTE_R | PTE_X) < 0)
-        panic("kvminit: text map failed");
+    if (map_range(pt, 0x80200000, (uint64)etext - 0x80200000, 0x80200000, PTE_R | PTE_X, max_level) < 0)
+        panic("kvmmake: text map failed");
+
+    // 映射内核数据段和剩余物理内存 (RW-)，物理内存顶部来自设备树
+    // etext 之后先用 4KB 页补齐到 2MB 边界，之后是 2MB 页，越过 1GB 边界后用 1GB 页
+    if (map_range(pt, (uint64)etext, machine.mem_top - (uint64)etext, (uint64)etext, PTE_R | PTE_W, max_level) < 0)
+        panic("kvmmake: data map failed");
+
+    return pt;
+}
 
-    // 映射内核数据段和剩余物理内存 (RW-)
-    if (mappages(kernel_pagetable, (uint64)etext, 0x88000000 - (uint64)etext, (uint64)etext, PTE_R | PTE_W) < 0)
-        panic("kvminit: data map failed");
-    
+// 创建内核页表
+void kvminit(void) {
+    kernel_pagetable = kvmmake(2);
     printf("kvminit: kernel page table created.\n");
+    vm_dump_stats("kernel", kernel_pagetable);
 }
 
 // 激活内核页表
@@ -122,4 +152,44 @@ void kvminithart(void) {
     w_satp(MAKE_SATP(kernel_pagetable));
     sfence_vma();
     printf("kvminithart: virtual memory enabled.\n");
-}
\ No newline at end of file
+}
+
+// 释放页表本身占用的页 (不释放叶子 PTE 指向的物理内存)
+void freewalk(pagetable_t pagetable) {
+    for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+        pte_t pte = pagetable[i];
+        if ((pte & PTE_V) && !PTE_LEAF(pte)) {
+            freewalk((pagetable_t)PTE2PA(pte));
+        }
+        pagetable[i] = 0;
+    }
+    kfree((void*)pagetable);
+    __atomic_fetch_sub(&nr_ptpages, 1, __ATOMIC_RELAXED);
+}
+
+static void count_ptes(pagetable_t pagetable, int level, uint64 *ptpages, uint64 *leaves) {
+    (*ptpages)++;
+    for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+        pte_t pte = pagetable[i];
+        if ((pte & PTE_V) == 0)
+            continue;
+        if (PTE_LEAF(pte))
+            leaves[level]++;
+        else if (level > 0)
+            count_ptes((pagetable_t)PTE2PA(pte), level - 1, ptpages, leaves);
+    }
+}
+
+// 统计一个页表占用的页表页数和各级叶子 PTE 数
+uint64 vm_ptpages(pagetable_t pagetable) {
+    uint64 ptpages = 0, leaves[3] = {0, 0, 0};
+    count_ptes(pagetable, 2, &ptpages, leaves);
+    return ptpages;
+}
+
+void vm_dump_stats(const char *name, pagetable_t pagetable) {
+    uint64 ptpages = 0, leaves[3] = {0, 0, 0};
+    count_ptes(pagetable, 2, &ptpages, leaves);
+    printf("vm: %s page table: %lu page-table pages, leaves 4K=%lu 2M=%lu 1G=%lu (all tables: %lu pages)\n",
+           name, ptpages, leaves[0], leaves[1], leaves[2], nr_ptpages);
+}